@@ -35,6 +35,24 @@
 #define FTI_BUFS    256
 /** Word size used during RS encoding.                                     */
 #define FTI_WORD    16
+/** Checkpoint I/O mode writing dataset per dataset with stdio.            */
+#define FTI_IO_STDIO 0
+/** Checkpoint I/O mode writing all datasets with vectored I/O.            */
+#define FTI_IO_VECT  1
+/** Absolute error bound for datasets stored with lossy compression.      */
+#define FTI_EABS     1
+/** Relative error bound for datasets stored with lossy compression.      */
+#define FTI_EREL     2
+/** Version of the checkpoint file header.                                 */
+#define FTI_TOC_VERSION 1
+/** Alignment of the first dataset in the checkpoint files.                */
+#define FTI_TOC_ALIGN   4096
+/** Header flag telling that the TOC has the dataset checksums.            */
+#define FTI_TOC_CRC     1
+/** Offset of the checkpoint image in the memory (L0) segments.           */
+#define FTI_MEM_HEAD    4096
+/** Largest message sent when replicating the memory checkpoints.         */
+#define FTI_MEM_CHUNK   (1UL << 30)
 /** Token returned when FTI performs a checkpoint.                         */
 #define FTI_DONE    1
 /** Token returned if a FTI function succeeds.                             */
@@ -129,8 +147,92 @@ typedef struct FTIT_dataset {           /** Dataset metadata.              */
     FTIT_type       type;               /** Data type for the dataset.     */
     int             eleSize;            /** Element size for the dataset.  */
     long            size;               /** Total size of the dataset.     */
+    int             tracked;            /** TRUE if page writes tracked.   */
+    int             mappable;           /** TRUE if mapped at restart.     */
+    int             errMode;            /** Error bound type, 0 if exact.  */
+    double          errBound;           /** Error bound for lossy storage. */
 } FTIT_dataset;
 
+/*-------------------------------------------------------------------------*/
+/** @typedef    FTIT_varmeta
+    @brief      Metadata of a dataset stored in a checkpoint file.
+
+    This type stores how a dataset was stored in a compressed checkpoint
+    file, so that it can be decompressed at recovery.
+*/
+/*-------------------------------------------------------------------------*/
+typedef struct FTIT_varmeta {           /** Stored dataset metadata.       */
+    int             id;                 /** ID of the dataset.             */
+    int             codec;              /** Codec used to store it.        */
+    unsigned long   size;               /** Size in the checkpoint file.   */
+    double          bound;              /** Error bound of lossy codecs.   */
+} FTIT_varmeta;
+
+/*-------------------------------------------------------------------------*/
+/** @typedef    FTIT_crcmeta
+    @brief      Checksum of a part of a checkpoint file.
+
+    This type stores the size and the CRC32C of a dataset as written in a
+    checkpoint file, so that corrupted files can be detected at recovery.
+*/
+/*-------------------------------------------------------------------------*/
+typedef struct FTIT_crcmeta {           /** Checksum of a file part.       */
+    unsigned long   size;               /** Size in the checkpoint file.   */
+    unsigned int    crc;                /** CRC32C of the part.            */
+} FTIT_crcmeta;
+
+/*-------------------------------------------------------------------------*/
+/** @typedef    FTIT_tocheader
+    @brief      Header of a checkpoint file.
+
+    This type is written at the beginning of the checkpoint files, followed
+    by one FTIT_tocentry per dataset. The CRC covers the whole header area,
+    padded to FTI_TOC_ALIGN bytes, computed with the CRC field set to 0.
+*/
+/*-------------------------------------------------------------------------*/
+typedef struct FTIT_tocheader {         /** Checkpoint file header.        */
+    char            magic[8];           /** File signature.                */
+    unsigned int    version;            /** Version of the file format.    */
+    unsigned int    nbVar;              /** Number of datasets.            */
+    unsigned int    flags;              /** Header flags (FTI_TOC_CRC).    */
+    unsigned int    crc;                /** CRC32C of the header area.     */
+    unsigned long   dataOff;            /** Offset of the first dataset.   */
+} FTIT_tocheader;
+
+/*-------------------------------------------------------------------------*/
+/** @typedef    FTIT_tocentry
+    @brief      Table of contents entry of a checkpoint file.
+
+    This type describes where and how a dataset is stored in a checkpoint
+    file, so that it can be found by ID and checked at recovery.
+*/
+/*-------------------------------------------------------------------------*/
+typedef struct FTIT_tocentry {          /** Checkpoint file TOC entry.     */
+    int             id;                 /** ID of the dataset.             */
+    int             eleSize;            /** Element size in bytes.         */
+    int             codec;              /** Codec used to store it.        */
+    unsigned int    crc;                /** CRC32C of the stored bytes.    */
+    long            count;              /** Number of elements.            */
+    unsigned long   offset;             /** Offset in the checkpoint file. */
+    unsigned long   size;               /** Size in the checkpoint file.   */
+    double          bound;              /** Error bound of lossy codecs.   */
+} FTIT_tocentry;
+
+/*-------------------------------------------------------------------------*/
+/** @typedef    FTIT_memheader
+    @brief      Header of a memory checkpoint segment.
+
+    This type is written at the beginning of the shared memory segments of
+    the L0 checkpoints, the checkpoint image starting at FTI_MEM_HEAD.
+*/
+/*-------------------------------------------------------------------------*/
+typedef struct FTIT_memheader {         /** Memory checkpoint header.      */
+    char            magic[8];           /** Segment signature.             */
+    int             ckptID;             /** Checkpoint ID, -1 if invalid.  */
+    int             rank;               /** Rank holding the segment.      */
+    unsigned long   size;               /** Size of the checkpoint image.  */
+} FTIT_memheader;
+
 /*-------------------------------------------------------------------------*/
 /** @typedef    FTIT_execution
     @brief      Execution metadata
@@ -141,12 +243,18 @@ typedef struct FTIT_dataset {           /** Dataset metadata.              */
 typedef struct FTIT_execution {         /** Execution metadata.            */
     char            id[FTI_BUFS];       /** Execution ID.                  */
     char            ckptFile[FTI_BUFS]; /** Checkpoint file name.          */
+    char            incChain[FTI_BUFS]; /** Previous ckpt. IDs of chain.   */
     int             ckpt;               /** Checkpoint flag.               */
     int             reco;               /** Recovery flag.                 */
     int             ckptLvel;           /** Checkpoint level.              */
     int             ckptIntv;           /** Ckpt. interval in minutes.     */
     int             lastCkptLvel;       /** Last checkpoint level.         */
     int             wasLastOffline;     /** TRUE if last ckpt. offline.    */
+    int             postDone;           /** TRUE if post-ckpt. work done.  */
+    int             l3WordSize;         /** RS word size of the L3 ckpt.   */
+    int             l3PacketSize;       /** Packet size of the L3 ckpt.    */
+    int             l3Parity;           /** Encoded files of the L3 ckpt.  */
+    int             l3Xor;              /** TRUE if L3 ckpt. XOR parity.   */
     double          iterTime;           /** Current wall time.             */
     double          lastIterTime;       /** Time spent in the last iter.   */
     double          meanIterTime;       /** Mean iteration time.           */
@@ -161,8 +269,13 @@ typedef struct FTIT_execution {         /** Execution metadata.            */
     unsigned int    ckptSize;           /** Checkpoint size.               */
     unsigned int    nbVar;              /** Number of protected variables. */
     unsigned int    nbType;             /** Number of data types.          */
+    unsigned int    nbStored;           /** Number of compressed datasets. */
+    FTIT_varmeta    varMeta[FTI_BUFS];  /** Compressed datasets metadata.  */
+    unsigned int    nbCrc;              /** Number of file parts checked.  */
+    FTIT_crcmeta    crcMeta[FTI_BUFS];  /** Checksums of the file parts.   */
     MPI_Comm        globalComm;         /** Global communicator.           */
     MPI_Comm        groupComm;          /** Group communicator.            */
+    MPI_Comm        postComm;           /** Post-processing communicator.  */
 } FTIT_execution;
 
 /*-------------------------------------------------------------------------*/
@@ -180,6 +293,21 @@ typedef struct FTIT_configuration {     /** Configuration metadata.        */
     int             tag;                /** Tag for MPI messages in FTI.   */
     int             test;               /** TRUE if local test.            */
     int             l3WordSize;         /** RS encoding word size.         */
+    int             l3PacketSize;       /** XOR packet size, 0 if unused.  */
+    int             l3Reduce;           /** TRUE to encode by reduce-scat. */
+    int             l3Threads;          /** Threads encoding each block.   */
+    int             l3Parity;           /** Encoded files in each group.   */
+    int             l3Xor;              /** TRUE for L3 single XOR parity. */
+    int             ioMode;             /** Checkpoint I/O mode.           */
+    int             directIO;           /** TRUE if O_DIRECT I/O is used.  */
+    int             ckptThread;         /** TRUE to ckpt. from a thread.   */
+    int             incBlockSize;       /** Incremental ckpt. block size.  */
+    int             incMaxDeltas;       /** Max. deltas in a ckpt. chain.  */
+    int             compress;           /** TRUE to compress checkpoints.  */
+    int             ioThreads;          /** Number of ckpt. write threads. */
+    int             ckptCrc;            /** TRUE to checksum the datasets. */
+    int             mmapRestart;        /** TRUE to map ckpt. at restart.  */
+    int             pipeDepth;          /** Blocks in flight in L2 ring.   */
     char            localDir[FTI_BUFS]; /** Local directory.               */
     char            glbalDir[FTI_BUFS]; /** Global directory.              */
     char            metadDir[FTI_BUFS]; /** Metadata directory.            */
@@ -298,9 +426,13 @@ int FTI_Init(char *configFile, MPI_Comm globalComm);
 int FTI_Status();
 int FTI_InitType(FTIT_type *type, int size);
 int FTI_Protect(int id, void *ptr, long count, FTIT_type type);
+int FTI_Track(int id);
+int FTI_Mappable(int id);
+int FTI_ErrorBound(int id, double bound, int mode);
 int FTI_BitFlip(int datasetID);
 int FTI_Checkpoint(int id, int level);
 int FTI_Recover();
+int FTI_RecoverVar(int id);
 int FTI_Snapshot();
 int FTI_Finalize();
 
@@ -316,18 +448,71 @@ int FTI_CheckErasures(unsigned long *fs, unsigned long *maxFs, int group, int *e
 int FTI_Clean(int level, int group, int rank);
 int FTI_Local(int group);
 int FTI_Ptner(int group);
+int* FTI_RSmatrix(int w);
+int FTI_RSinit(int w);
+void FTI_RSmul(char **data, int k, int *row, int w, char *coding, int add, int bs);
+void FTI_RSxor(char **data, int k, int **schedule, int w, int pk, char **coding, int m, int bs);
+int* FTI_RSbitmatrix(int w, int ***schedule);
+int FTI_PtnerRing(FILE *lfd, char *hdr, unsigned long hsize, FTIT_dataset* FTI_Data,
+                  unsigned long fs, unsigned long maxFs, FILE *pfd);
 int FTI_RSenc(int group);
+void FTI_XORrow(FILE *fd, unsigned long fs, char *data);
+int FTI_XORenc(int group);
 int FTI_Flush(int group, int level);
 int FTI_RecoverL1(int group);
 int FTI_RecoverL2(int group);
 int FTI_RecoverL3(int group);
+int FTI_XORdec(unsigned long fs, unsigned long maxFs, int *erased);
 int FTI_RecoverL4(int group);
 int FTI_GetMeta(unsigned long *fs, unsigned long *mfs, int group, int level);
+int FTI_GetPtnerSize(unsigned long *pfs, unsigned int *pnb, FTIT_crcmeta *pcm, int group, int level);
 int FTI_CreateMetadata(int globalTmp);
 int FTI_RmDir(char path[FTI_BUFS], int flag);
 int FTI_UpdateIterTime();
 int FTI_PostCkpt(int group, int fo, int pr);
+int FTI_WriteFull(char *fn, FTIT_dataset* FTI_Data);
 int FTI_WriteCkpt(FTIT_dataset* FTI_Data);
+int FTI_WritePtner(char *fn, FTIT_dataset* FTI_Data);
+int FTI_WriteRSenc(char *fn, FTIT_dataset* FTI_Data);
+int FTI_WriteVect(char *fn, FTIT_dataset* FTI_Data);
+int FTI_WriteThreads(char *fn, FTIT_dataset* FTI_Data);
+int FTI_WriteDirect(char *fn, FTIT_dataset* FTI_Data);
+int FTI_CopyDirect(char *src, char *dst, unsigned long fs);
+int FTI_MapVar(int fd, FTIT_dataset *data, unsigned long off);
+int FTI_PoolInit(int nbThreads);
+int FTI_PoolRun(int (*func)(void *arg, int task), void *arg, int nbTasks);
+int FTI_PoolStop();
+int FTI_ThreadInit();
+int FTI_ThreadCkpt(FTIT_dataset* FTI_Data);
+int FTI_ThreadWait();
+int FTI_ThreadStop();
+int FTI_IncPrepare(FTIT_dataset* FTI_Data);
+int FTI_WriteDelta(char *fn, FTIT_dataset* FTI_Data);
+int FTI_IncCommit(int res);
+int FTI_IncReset();
+int FTI_IncCheck(char *dir);
+int FTI_IncRecover(FTIT_dataset* FTI_Data, int id);
+int FTI_IncFlatten(char *lfn, char *gfn);
+int FTI_TrackInit(FTIT_dataset* FTI_Data, int i);
+int FTI_TrackCapture();
+int FTI_TrackBlock(int i, long off, unsigned long len);
+int FTI_TrackStop();
+int FTI_CompCheck(FTIT_dataset* FTI_Data);
+int FTI_WriteComp(char *fn, FTIT_dataset* FTI_Data);
+int FTI_ReadVar(FILE *fd, FTIT_dataset *data, FTIT_tocentry *te);
+unsigned int FTI_Crc32c(unsigned int crc, void *buf, unsigned long len);
+int FTI_CrcData(FTIT_dataset* FTI_Data);
+int FTI_CrcCheck(char *fn, unsigned long fs, unsigned int nb, FTIT_crcmeta *cm);
+unsigned long FTI_TocSize(int nbVar);
+char* FTI_TocBuild(FTIT_dataset* FTI_Data, unsigned long *hsize);
+int FTI_TocRead(FILE *fd, FTIT_tocheader *hdr, FTIT_tocentry *toc);
+int FTI_ReadCkptFd(FILE *fd, FTIT_dataset* FTI_Data, int id);
+int FTI_ReadCkpt(char *fn, FTIT_dataset* FTI_Data, int id);
+int FTI_MemCkpt(FTIT_dataset* FTI_Data, int id);
+int FTI_MemDrop();
+int FTI_MemRecover();
+int FTI_MemRead(FTIT_dataset* FTI_Data, int id);
+int FTI_MemFree();
 int FTI_Listen();
 int FTI_RecoverFiles();
 int FTI_UpdateConf(int restart);
@@ -60,7 +60,13 @@ int FTI_Init(char *configFile, MPI_Comm globalComm) {
     res = FTI_Try(FTI_Topology(), "build topology.");
     if (res == FTI_NSCS) FTI_Abort();
     FTI_Try(FTI_InitBasicTypes(FTI_Data), "create the basic data types.");
+    FTI_Try(FTI_RSinit(FTI_Conf.l3WordSize), "prepare the L3 encoding.");
     if (FTI_Topo.myRank == 0) FTI_Try(FTI_UpdateConf(1), "update configuration file.");
+    if (FTI_Conf.ioThreads > 1 || FTI_Conf.l3Threads > 1)
+    { // Also used by the L3 encoding and decoding, of the heads as well
+        int nbThreads = (FTI_Conf.ioThreads > FTI_Conf.l3Threads) ? FTI_Conf.ioThreads : FTI_Conf.l3Threads;
+        FTI_Try(FTI_PoolInit(nbThreads), "start the I/O threads.");
+    }
     if (FTI_Topo.amIaHead)
     { // If I am a FTI dedicated process
         if (FTI_Exec.reco)
@@ -81,6 +87,10 @@ int FTI_Init(char *configFile, MPI_Comm globalComm) {
             if (res == FTI_NSCS) FTI_Abort();
             FTI_Exec.ckptCnt = FTI_Exec.ckptID;
         }
+        if (FTI_Conf.ckptThread)
+        {
+            FTI_Try(FTI_ThreadInit(), "start the ckpt. thread.");
+        }
     }
     FTI_Print("FTI has been initialized.", FTI_INFO);
     return FTI_SCES;
@@ -135,18 +145,21 @@ int FTI_InitType(FTIT_type *type, int size) {
     structures is the data that will be stored during a checkpoint and
     loaded during a recovery. It resets the pointer to a data structure,
     its size, its number of elements and the type of the elements if the
-    dataset was already previously registered.
+    dataset was already previously registered. A checkpoint still written
+    by the checkpoint thread is waited for first.
 
  **/
 /*-------------------------------------------------------------------------*/
 int FTI_Protect(int id, void *ptr, long count, FTIT_type type) {
-    int i, prevSize, updated = 0;
+    int i, prevSize, moved, updated = 0;
     char str[FTI_BUFS];
     float ckptSize;
+    if (FTI_Conf.ckptThread) FTI_ThreadWait(); // The thread reads the datasets
     for (i = 0; i < FTI_BUFS; i++)
     {
         if (id == FTI_Data[i].id)
         {
+            moved = (FTI_Data[i].ptr != ptr || FTI_Data[i].size != type.size*count);
             prevSize = FTI_Data[i].size;
             FTI_Data[i].ptr = ptr;
             FTI_Data[i].count = count;
@@ -154,6 +167,12 @@ int FTI_Protect(int id, void *ptr, long count, FTIT_type type) {
             FTI_Data[i].eleSize = type.size;
             FTI_Data[i].size = type.size*count;
             FTI_Exec.ckptSize = FTI_Exec.ckptSize + (type.size*count) - prevSize;
+            if (moved) FTI_Data[i].mappable = 0; // Marked for the previous buffer
+            if (FTI_Data[i].tracked && moved)
+            { // Track the new region, the blocks hashed before cannot be trusted
+                FTI_TrackInit(FTI_Data, i);
+                FTI_IncReset();
+            }
             updated = 1;
         }
     }
@@ -177,6 +196,10 @@ int FTI_Protect(int id, void *ptr, long count, FTIT_type type) {
         FTI_Data[FTI_Exec.nbVar].type = type;
         FTI_Data[FTI_Exec.nbVar].eleSize = type.size;
         FTI_Data[FTI_Exec.nbVar].size = type.size*count;
+        FTI_Data[FTI_Exec.nbVar].tracked = 0;
+        FTI_Data[FTI_Exec.nbVar].mappable = 0;
+        FTI_Data[FTI_Exec.nbVar].errMode = 0;
+        FTI_Data[FTI_Exec.nbVar].errBound = 0;
         FTI_Exec.nbVar = FTI_Exec.nbVar + 1;
         FTI_Exec.ckptSize = FTI_Exec.ckptSize + (type.size*count);
         ckptSize = FTI_Exec.ckptSize/(1024.0*1024.0);
@@ -187,6 +210,145 @@ int FTI_Protect(int id, void *ptr, long count, FTIT_type type) {
 }
 
 
+/*-------------------------------------------------------------------------*/
+/**
+    @brief      It tracks the writes to a protected variable.
+    @param      id              ID of the protected variable.
+    @return     integer         FTI_SCES if successful.
+
+    This function makes the incremental checkpoints detect the changed
+    blocks of a protected variable through page protection instead of
+    hashing. After each checkpoint, the pages fully covered by the variable
+    are made read-only and the first write to a page is caught to mark it
+    as dirty. The variable must not be the target of system calls or MPI
+    receptions (they fail with EFAULT on a protected page).
+
+ **/
+/*-------------------------------------------------------------------------*/
+int FTI_Track(int id) {
+    char str[FTI_BUFS];
+    int i;
+    if (FTI_Conf.incBlockSize == 0)
+    {
+        FTI_Print("Tracking needs incremental checkpointing (Inc_block_size).", FTI_WARN);
+        return FTI_NSCS;
+    }
+    for (i = 0; i < FTI_Exec.nbVar; i++)
+    {
+        if (id == FTI_Data[i].id) break;
+    }
+    if (i == FTI_Exec.nbVar)
+    {
+        sprintf(str, "Variable ID %d is not protected and cannot be tracked.", id);
+        FTI_Print(str, FTI_WARN);
+        return FTI_NSCS;
+    }
+    if (FTI_Data[i].tracked) return FTI_SCES;
+    if (FTI_Conf.ckptThread) FTI_ThreadWait();
+    FTI_Data[i].tracked = 1;
+    sprintf(str, "Variable ID %d is tracked.", id);
+    FTI_Print(str, FTI_DBUG);
+    return FTI_TrackInit(FTI_Data, i);
+}
+
+
+/*-------------------------------------------------------------------------*/
+/**
+    @brief      It lets a protected variable be mapped at restart.
+    @param      id              ID of the protected variable.
+    @return     integer         FTI_SCES if successful.
+
+    This function marks a protected variable whose buffer starts on a page
+    and owns all the pages it covers, e.g. allocated with posix_memalign or
+    mmap, so that Mmap_restart can replace those pages with a mapping of
+    the checkpoint file. The mark is dropped if the variable is protected
+    again with another buffer.
+
+ **/
+/*-------------------------------------------------------------------------*/
+int FTI_Mappable(int id) {
+    char str[FTI_BUFS];
+    int i;
+    if (FTI_Conf.mmapRestart == 0)
+    {
+        FTI_Print("Mapping at restart needs Mmap_restart.", FTI_WARN);
+        return FTI_NSCS;
+    }
+    if (FTI_Conf.ckptThread) FTI_ThreadWait();
+    for (i = 0; i < FTI_Exec.nbVar; i++)
+    {
+        if (id == FTI_Data[i].id) break;
+    }
+    if (i == FTI_Exec.nbVar)
+    {
+        sprintf(str, "Variable ID %d is not protected and cannot be mapped.", id);
+        FTI_Print(str, FTI_WARN);
+        return FTI_NSCS;
+    }
+    if ((unsigned long) FTI_Data[i].ptr % sysconf(_SC_PAGESIZE) != 0)
+    {
+        sprintf(str, "Variable ID %d is not page-aligned and cannot be mapped.", id);
+        FTI_Print(str, FTI_WARN);
+        return FTI_NSCS;
+    }
+    FTI_Data[i].mappable = 1;
+    sprintf(str, "Variable ID %d can be mapped at restart.", id);
+    FTI_Print(str, FTI_DBUG);
+    return FTI_SCES;
+}
+
+
+/*-------------------------------------------------------------------------*/
+/**
+    @brief      It sets the error bound of a protected variable.
+    @param      id              ID of the protected variable.
+    @param      bound           Error bound, larger than 0.
+    @param      mode            FTI_EABS (absolute) or FTI_EREL (relative).
+    @return     integer         FTI_SCES if successful.
+
+    This function allows FTI to store a floating point variable with lossy
+    compression. The values recovered from the checkpoints differ from the
+    checkpointed ones by at most the bound (absolute), or by at most the
+    bound times the value (relative). With an absolute bound the values are
+    quantized, and with a relative bound the low bits of the mantissas are
+    dropped. The bound is kept if the variable is protected again.
+
+ **/
+/*-------------------------------------------------------------------------*/
+int FTI_ErrorBound(int id, double bound, int mode) {
+    char str[FTI_BUFS];
+    int i;
+    if (FTI_Conf.ckptThread) FTI_ThreadWait();
+    for (i = 0; i < FTI_Exec.nbVar; i++)
+    {
+        if (id == FTI_Data[i].id) break;
+    }
+    if (i == FTI_Exec.nbVar)
+    {
+        sprintf(str, "Variable ID %d is not protected, no error bound set.", id);
+        FTI_Print(str, FTI_WARN);
+        return FTI_NSCS;
+    }
+    if (FTI_Data[i].type.id != FTI_DBLE.id && FTI_Data[i].type.id != FTI_SFLT.id)
+    {
+        sprintf(str, "Variable ID %d is not a floating point variable.", id);
+        FTI_Print(str, FTI_WARN);
+        return FTI_NSCS;
+    }
+    if ((mode != FTI_EABS && mode != FTI_EREL) || !(bound > 0))
+    {
+        FTI_Print("Error bound needs a positive bound and FTI_EABS or FTI_EREL.", FTI_WARN);
+        return FTI_NSCS;
+    }
+    FTI_Data[i].errMode = mode;
+    FTI_Data[i].errBound = bound;
+    sprintf(str, "Variable ID %d stored with %s error bound %g.", id,
+            (mode == FTI_EABS) ? "absolute" : "relative", bound);
+    FTI_Print(str, FTI_DBUG);
+    return FTI_SCES;
+}
+
+
 /*-------------------------------------------------------------------------*/
 /**
     @brief      It corrupts a bit of the given float.
@@ -310,6 +472,8 @@ int FTI_BitFlip(int datasetID)
     offline. Then, it updates the ckpt. information. It writes down the ckpt.
     data, creates the metadata and the post-processing work. This function
     is complementary with the FTI_Listen function in terms of communications.
+    Level 0 checkpoints are kept in memory by FTI_MemCkpt, without files,
+    metadata nor post-processing. Any other level invalidates them.
 
  **/
 /*-------------------------------------------------------------------------*/
@@ -318,13 +482,42 @@ int FTI_Checkpoint(int id, int level) {
     double t0, t1, t2, t3, t4;
     char str[FTI_BUFS];
     MPI_Status status;
+    if (level == 0)
+    { // Memory copies on this process and its partner
+        t0 = MPI_Wtime();
+        if (FTI_Conf.ckptThread) FTI_ThreadWait();
+        res = FTI_Try(FTI_MemCkpt(FTI_Data, id), "take the memory checkpoint.");
+        sprintf(str, "Ckpt. ID %d (L0) (%.2f MB/proc) taken in %.2f sec.", id,
+                FTI_Exec.ckptSize/(1024.0*1024.0), MPI_Wtime()-t0);
+        FTI_Print(str, FTI_INFO);
+        return (res == FTI_SCES) ? FTI_DONE : FTI_NSCS;
+    }
     if ((level > 0) && (level < 5))
     {
         t0 = MPI_Wtime();
+        if (FTI_Conf.ckptThread)
+        { // Block until previous checkpoint is done (Thread work)
+            FTI_ThreadWait();
+        }
         FTI_Exec.ckptID = id;
         FTI_Exec.ckptLvel = level;
+        if (FTI_Conf.incBlockSize)
+        { // Writes to the tracked variables now go to the next checkpoint
+            FTI_TrackCapture();
+        }
         sprintf(str, "Ckpt. ID %d", FTI_Exec.ckptID);
         sprintf(str, "%s (L%d) (%.2f MB/proc)", str, FTI_Exec.ckptLvel, FTI_Exec.ckptSize/(1024.0*1024.0));
+        if (FTI_Conf.ckptThread)
+        { // Stage the checkpoint, the thread writes and post-processes it
+            t1 = MPI_Wtime();
+            res = FTI_Try(FTI_ThreadCkpt(FTI_Data), "stage the checkpoint.");
+            if (res == FTI_SCES) FTI_MemDrop();
+            t2 = MPI_Wtime();
+            sprintf(str, "%s staged in %.2f sec. (Wt:%.2fs, St:%.2fs)", str, t2-t0, t1-t0, t2-t1);
+            FTI_Print(str, FTI_INFO);
+            if (res == FTI_SCES) res = FTI_DONE;
+            return res;
+        }
         if (FTI_Exec.wasLastOffline == 1)
         { // Block until previous checkpoint is done (Async. work)
             MPI_Recv(&res, 1, MPI_INT, FTI_Topo.headRank, FTI_Conf.tag, FTI_Exec.globalComm, &status);
@@ -337,6 +530,7 @@ int FTI_Checkpoint(int id, int level) {
         }
         t1 = MPI_Wtime();
         res = FTI_Try(FTI_WriteCkpt(FTI_Data), "write the checkpoint.");
+        if (res == FTI_SCES) FTI_MemDrop();
         //MPI_Allreduce(&res, &tres, 1, MPI_INT, MPI_SUM, FTI_COMM_WORLD);
         t2 = MPI_Wtime();
         if (!FTI_Ckpt[FTI_Exec.ckptLvel].isInline)
@@ -353,6 +547,7 @@ int FTI_Checkpoint(int id, int level) {
             FTI_Exec.wasLastOffline = 0;
             if (res != FTI_SCES) FTI_Exec.ckptLvel = FTI_REJW-FTI_BASE;
             res = FTI_Try(FTI_PostCkpt(FTI_Topo.groupID, -1, 1), "postprocess the checkpoint.");
+            if (FTI_Conf.incBlockSize) FTI_IncCommit(res);
             if (res == FTI_SCES)
             {
                 FTI_Exec.wasLastOffline = 0;
@@ -376,14 +571,21 @@ int FTI_Checkpoint(int id, int level) {
     @return     integer         FTI_SCES if successful.
 
     This function loads the checkpoint data from the checkpoint file and
-    it updates some basic checkpoint information.
+    it updates some basic checkpoint information. The datasets are looked up
+    by ID in the table of contents of the file, and compressed datasets are
+    decompressed directly in the protected buffers. After a recovery from
+    level 0, they are read from the memory checkpoint instead.
 
  **/
 /*-------------------------------------------------------------------------*/
 int FTI_Recover() {
     char fn[FTI_BUFS], str[FTI_BUFS];
-    FILE *fd;
-    int i;
+    if (FTI_Exec.ckptLvel == 0)
+    { // Checkpoint kept in memory
+        if (FTI_Try(FTI_MemRead(FTI_Data, -1), "read the memory checkpoint.") != FTI_SCES) return FTI_NSCS;
+        FTI_Exec.reco = 0;
+        return FTI_SCES;
+    }
     sprintf(fn,"%s/%s" ,FTI_Ckpt[FTI_Exec.ckptLvel].dir, FTI_Exec.ckptFile);
     sprintf(str, "Trying to load FTI checkpoint file (%s)...", fn);
     FTI_Print(str, FTI_DBUG);
@@ -392,23 +594,65 @@ int FTI_Recover() {
         FTI_Print("FTI checkpoint file is NOT accesible.", FTI_EROR);
         return FTI_NSCS;
     }
-    fd = fopen(fn, "rb");
-    if (fd == NULL)
+    if (FTI_Exec.incChain[0] != '\0')
+    { // Base checkpoint and deltas of an incremental chain
+        if (FTI_Try(FTI_IncRecover(FTI_Data, -1), "recover the ckpt. chain.") != FTI_SCES) return FTI_NSCS;
+        FTI_Exec.reco = 0;
+        return FTI_SCES;
+    }
+    if (FTI_Try(FTI_ReadCkpt(fn, FTI_Data, -1), "read the checkpoint file.") != FTI_SCES) return FTI_NSCS;
+    FTI_Exec.reco = 0;
+    return FTI_SCES;
+}
+
+
+/*-------------------------------------------------------------------------*/
+/**
+    @brief      It loads one dataset from the checkpoint data.
+    @param      id              ID of the dataset to load.
+    @return     integer         FTI_SCES if successful.
+
+    This function loads a single protected dataset from the checkpoint file
+    of the level being recovered, reading only its range as given by the
+    table of contents. It can be called several times before FTI_Recover,
+    for instance to check a small dataset before loading the large ones, and
+    it does not end the recovery. With Ckpt_crc set, the whole file was
+    already read by FTI_Init to check it against the metadata.
+
+ **/
+/*-------------------------------------------------------------------------*/
+int FTI_RecoverVar(int id) {
+    char fn[FTI_BUFS], str[FTI_BUFS];
+    int i;
+    if (!FTI_Exec.reco)
     {
-        FTI_Print("Could not open FTI checkpoint file.", FTI_EROR);
+        FTI_Print("There is no checkpoint to recover from.", FTI_WARN);
         return FTI_NSCS;
     }
-    for(i = 0; i < FTI_Exec.nbVar; i++)
+    for (i = 0; i < FTI_Exec.nbVar && FTI_Data[i].id != id; i++);
+    if (i == FTI_Exec.nbVar)
     {
-        fread(FTI_Data[i].ptr, 1, FTI_Data[i].size, fd);
+        sprintf(str, "Dataset #%d is not protected.", id);
+        FTI_Print(str, FTI_WARN);
+        return FTI_NSCS;
+    }
+    if (FTI_Exec.ckptLvel == 0)
+    { // Checkpoint kept in memory
+        return FTI_Try(FTI_MemRead(FTI_Data, id), "read the dataset from the memory checkpoint.");
     }
-    if (fclose(fd) != 0)
+    sprintf(fn,"%s/%s" ,FTI_Ckpt[FTI_Exec.ckptLvel].dir, FTI_Exec.ckptFile);
+    sprintf(str, "Trying to load dataset #%d from FTI checkpoint file (%s)...", id, fn);
+    FTI_Print(str, FTI_DBUG);
+    if (access(fn, F_OK) != 0)
     {
-        FTI_Print("Could not close FTI checkpoint file.", FTI_EROR);
+        FTI_Print("FTI checkpoint file is NOT accesible.", FTI_EROR);
         return FTI_NSCS;
     }
-    FTI_Exec.reco = 0;
-    return FTI_SCES;
+    if (FTI_Exec.incChain[0] != '\0')
+    { // Base checkpoint and deltas of an incremental chain
+        return FTI_Try(FTI_IncRecover(FTI_Data, id), "recover the dataset from the ckpt. chain.");
+    }
+    return FTI_Try(FTI_ReadCkpt(fn, FTI_Data, id), "read the dataset from the checkpoint file.");
 }
 
 
@@ -452,6 +696,10 @@ int FTI_Snapshot() {
                     level = i;
                 }
             }
+            if (level == -1 && FTI_Ckpt[0].ckptIntv > 0 && FTI_Exec.ckptCnt % FTI_Ckpt[0].ckptIntv == 0)
+            { // Memory checkpoint if no file checkpoint is due
+                level = 0;
+            }
             if (level != -1)
             {
                     res = FTI_Try(FTI_Checkpoint(FTI_Exec.ckptCnt, level), "take checkpoint.");
@@ -491,6 +739,16 @@ int FTI_Finalize() {
                 FTI_Exec.lastCkptLvel = FTI_Exec.ckptLvel;
             }
         }
+        if (FTI_Conf.ckptThread)
+        { // Finish the last staged checkpoint before cleaning
+            FTI_ThreadStop();
+        }
+        if (FTI_Conf.incBlockSize)
+        { // Give write access back to the tracked variables
+            FTI_TrackStop();
+        }
+        FTI_PoolStop();
+        FTI_MemFree();
         buff = FTI_ENDW;
         if (FTI_Topo.nbHeads == 1)
         { // Send notice to the head to stop listening
@@ -501,6 +759,11 @@ int FTI_Finalize() {
             if (FTI_Exec.lastCkptLvel != 4)
             {
                 FTI_Try(FTI_Flush(FTI_Topo.groupID, FTI_Exec.lastCkptLvel), "save the last ckpt. in the PFS.");
+                if (FTI_Conf.incBlockSize)
+                { // The flushed files are full checkpoints, without chain
+                    FTI_Exec.incChain[0] = '\0';
+                    FTI_Try(FTI_CreateMetadata(1), "create the metadata of the last ckpt.");
+                }
                 MPI_Barrier(FTI_COMM_WORLD);
                 if (FTI_Topo.splitRank == 0)
 		{
@@ -508,6 +771,11 @@ int FTI_Finalize() {
                         FTI_RmDir(FTI_Ckpt[4].dir, 1);
                     if (access(FTI_Ckpt[4].metaDir,0)==0)
                         FTI_RmDir(FTI_Ckpt[4].metaDir, 1);
+                    if (FTI_Conf.incBlockSize)
+                    {
+                        FTI_RmDir(FTI_Ckpt[FTI_Exec.lastCkptLvel].metaDir, 1);
+                        rename(FTI_Conf.mTmpDir, FTI_Ckpt[FTI_Exec.lastCkptLvel].metaDir);
+                    }
                     rename(FTI_Ckpt[FTI_Exec.lastCkptLvel].metaDir, FTI_Ckpt[4].metaDir);
                     rename(FTI_Conf.gTmpDir, FTI_Ckpt[4].dir);
                 }
@@ -528,6 +796,7 @@ int FTI_Finalize() {
         FTI_Try(FTI_Clean(buff, FTI_Topo.groupID, FTI_Topo.myRank), "do final clean.");
         FTI_Print("FTI has been finalized.", FTI_INFO);
     } else {
+        FTI_PoolStop();
         MPI_Barrier(FTI_Exec.globalComm);
         MPI_Finalize();
         exit(0);
@@ -0,0 +1,235 @@
+/**
+ *  @file   async.c
+ *  @author Leonardo A. Bautista Gomez (leobago@gmail.com)
+ *  @date   October, 2026
+ *  @brief  In-process asynchronous checkpointing for the FTI library.
+ */
+
+
+#include "fti.h"
+#include <pthread.h>
+
+
+/** Copies of the datasets pointing to the staging buffer.                 */
+static FTIT_dataset        FTI_Stage[FTI_BUFS];
+
+/** Staging buffer where the protected data is copied.                     */
+static char                *FTI_StageBuf = NULL;
+
+/** Size of the staging buffer.                                            */
+static unsigned long       FTI_StageSize = 0;
+
+/** Checkpoint thread and its synchronization variables.                   */
+static pthread_t           FTI_Thread;
+static pthread_mutex_t     FTI_ThreadLock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t      FTI_ThreadCond = PTHREAD_COND_INITIALIZER;
+
+/** TRUE if a staged checkpoint is waiting or being written.               */
+static int                 FTI_ThreadBusy = 0;
+
+/** TRUE if the checkpoint thread has been asked to stop.                  */
+static int                 FTI_ThreadEnd = 0;
+
+/** Result of the last checkpoint done by the thread.                      */
+static int                 FTI_ThreadRes = FTI_SCES;
+
+
+/*-------------------------------------------------------------------------*/
+/**
+    @brief      It writes and post-processes the staged checkpoint.
+    @return     integer         FTI_SCES if successful.
+
+    This function does, in the checkpoint thread, the work that the
+    application process does for an inline checkpoint: it writes the
+    staged data, creates the metadata and post-processes the checkpoint.
+
+ **/
+/*-------------------------------------------------------------------------*/
+int FTI_ThreadWork() {
+    double t0, t1, t2;
+    char str[FTI_BUFS];
+    int res;
+    t0 = MPI_Wtime();
+    res = FTI_Try(FTI_WriteCkpt(FTI_Stage), "write the checkpoint.");
+    t1 = MPI_Wtime();
+    if (res != FTI_SCES) FTI_Exec.ckptLvel = FTI_REJW-FTI_BASE;
+    res = FTI_Try(FTI_PostCkpt(FTI_Topo.groupID, -1, 1), "postprocess the checkpoint.");
+    if (FTI_Conf.incBlockSize) FTI_IncCommit(res);
+    if (res == FTI_SCES)
+    {
+        FTI_Exec.lastCkptLvel = FTI_Exec.ckptLvel;
+    }
+    t2 = MPI_Wtime();
+    sprintf(str, "Ckpt. ID %d done by the ckpt. thread in %.2f sec. (Wr:%.2fs, Ps:%.2fs)",
+            FTI_Exec.ckptID, t2-t0, t1-t0, t2-t1);
+    FTI_Print(str, FTI_INFO);
+    return res;
+}
+
+
+/*-------------------------------------------------------------------------*/
+/**
+    @brief      Main loop of the checkpoint thread.
+    @param      arg             Unused.
+    @return     void*           NULL.
+
+    This function waits for staged checkpoints and processes them one by
+    one until FTI_ThreadStop is called.
+
+ **/
+/*-------------------------------------------------------------------------*/
+void* FTI_ThreadLoop(void *arg) {
+    int res;
+    pthread_mutex_lock(&FTI_ThreadLock);
+    while (1)
+    {
+        while (!FTI_ThreadBusy && !FTI_ThreadEnd)
+        {
+            pthread_cond_wait(&FTI_ThreadCond, &FTI_ThreadLock);
+        }
+        if (!FTI_ThreadBusy) break;
+        pthread_mutex_unlock(&FTI_ThreadLock);
+        res = FTI_ThreadWork();
+        pthread_mutex_lock(&FTI_ThreadLock);
+        FTI_ThreadRes = res;
+        FTI_ThreadBusy = 0;
+        pthread_cond_broadcast(&FTI_ThreadCond);
+    }
+    pthread_mutex_unlock(&FTI_ThreadLock);
+    return NULL;
+}
+
+
+/*-------------------------------------------------------------------------*/
+/**
+    @brief      It starts the checkpoint thread.
+    @return     integer         FTI_SCES if successful.
+
+    This function checks that MPI allows concurrent calls from several
+    threads, duplicates the communicator used for post-processing so that
+    its collectives never mix with the ones of the application, and starts
+    the checkpoint thread. The group communicator is not duplicated, the
+    application thread only uses it (memory checkpoints, recovery) after
+    FTI_ThreadWait. If MPI_THREAD_MULTIPLE is not available, the
+    checkpoints are done synchronously.
+
+ **/
+/*-------------------------------------------------------------------------*/
+int FTI_ThreadInit() {
+    int provided;
+    MPI_Query_thread(&provided);
+    if (provided < MPI_THREAD_MULTIPLE)
+    {
+        FTI_Print("MPI_THREAD_MULTIPLE not provided, ckpt. thread disabled.", FTI_WARN);
+        FTI_Conf.ckptThread = 0;
+        return FTI_NSCS;
+    }
+    MPI_Comm_dup(FTI_COMM_WORLD, &FTI_Exec.postComm);
+    FTI_ThreadEnd = 0;
+    FTI_ThreadBusy = 0;
+    if (pthread_create(&FTI_Thread, NULL, FTI_ThreadLoop, NULL) != 0)
+    {
+        FTI_Print("Ckpt. thread could not be created.", FTI_WARN);
+        MPI_Comm_free(&FTI_Exec.postComm);
+        FTI_Exec.postComm = FTI_COMM_WORLD;
+        FTI_Conf.ckptThread = 0;
+        return FTI_NSCS;
+    }
+    FTI_Print("Ckpt. thread started.", FTI_DBUG);
+    return FTI_SCES;
+}
+
+
+/*-------------------------------------------------------------------------*/
+/**
+    @brief      It waits until the checkpoint thread is idle.
+    @return     integer         Result of the last checkpoint of the thread.
+
+    This function blocks until the checkpoint previously staged, if any,
+    has been written and post-processed by the checkpoint thread.
+
+ **/
+/*-------------------------------------------------------------------------*/
+int FTI_ThreadWait() {
+    int res;
+    pthread_mutex_lock(&FTI_ThreadLock);
+    while (FTI_ThreadBusy)
+    {
+        pthread_cond_wait(&FTI_ThreadCond, &FTI_ThreadLock);
+    }
+    res = FTI_ThreadRes;
+    FTI_ThreadRes = FTI_SCES;
+    pthread_mutex_unlock(&FTI_ThreadLock);
+    return res;
+}
+
+
+/*-------------------------------------------------------------------------*/
+/**
+    @brief      It stages the protected data for the checkpoint thread.
+    @param      FTI_Data        Dataset array.
+    @return     integer         FTI_SCES if successful.
+
+    This function copies all the protected datasets in the staging buffer
+    and hands the checkpoint to the thread. The application can modify its
+    data as soon as this function returns. The thread must be idle, which
+    is ensured by calling FTI_ThreadWait before.
+
+ **/
+/*-------------------------------------------------------------------------*/
+int FTI_ThreadCkpt(FTIT_dataset* FTI_Data) {
+    unsigned long pos = 0;
+    char *tmp;
+    int i;
+    if (FTI_StageSize < FTI_Exec.ckptSize)
+    { // Grow the staging buffer to the current checkpoint size
+        tmp = realloc(FTI_StageBuf, FTI_Exec.ckptSize);
+        if (tmp == NULL)
+        {
+            FTI_Print("Staging buffer could not be allocated.", FTI_EROR);
+            return FTI_NSCS;
+        }
+        FTI_StageBuf = tmp;
+        FTI_StageSize = FTI_Exec.ckptSize;
+    }
+    for (i = 0; i < FTI_Exec.nbVar; i++)
+    {
+        FTI_Stage[i] = FTI_Data[i];
+        FTI_Stage[i].ptr = FTI_StageBuf + pos;
+        memcpy(FTI_Stage[i].ptr, FTI_Data[i].ptr, FTI_Data[i].size);
+        pos = pos + FTI_Data[i].size;
+    }
+    pthread_mutex_lock(&FTI_ThreadLock);
+    FTI_ThreadBusy = 1;
+    pthread_cond_broadcast(&FTI_ThreadCond);
+    pthread_mutex_unlock(&FTI_ThreadLock);
+    return FTI_SCES;
+}
+
+
+/*-------------------------------------------------------------------------*/
+/**
+    @brief      It stops the checkpoint thread.
+    @return     integer         Result of the last checkpoint of the thread.
+
+    This function waits for the last staged checkpoint, stops and joins the
+    checkpoint thread and frees the staging buffer and the post-processing
+    communicator.
+
+ **/
+/*-------------------------------------------------------------------------*/
+int FTI_ThreadStop() {
+    int res = FTI_ThreadWait();
+    pthread_mutex_lock(&FTI_ThreadLock);
+    FTI_ThreadEnd = 1;
+    pthread_cond_broadcast(&FTI_ThreadCond);
+    pthread_mutex_unlock(&FTI_ThreadLock);
+    pthread_join(FTI_Thread, NULL);
+    MPI_Comm_free(&FTI_Exec.postComm);
+    FTI_Exec.postComm = FTI_COMM_WORLD;
+    free(FTI_StageBuf);
+    FTI_StageBuf = NULL;
+    FTI_StageSize = 0;
+    FTI_Print("Ckpt. thread stopped.", FTI_DBUG);
+    return res;
+}
@@ -60,6 +60,80 @@ int FTI_UpdateIterTime() {
 }
 
 
+/*-------------------------------------------------------------------------*/
+/**
+    @brief      It writes a full checkpoint file.
+    @param      fn              Name of the checkpoint file.
+    @param      FTI_Data        Dataset array.
+    @return     integer         FTI_SCES if successful.
+
+    This function writes the header, the table of contents and all the
+    datasets as they are. If the vectored I/O mode is selected, all datasets
+    are written by FTI_WriteVect. Direct I/O, if enabled, takes precedence
+    over the I/O mode and over the parallel writes done by FTI_WriteThreads
+    with several I/O threads.
+
+ **/
+/*-------------------------------------------------------------------------*/
+int FTI_WriteFull(char *fn, FTIT_dataset* FTI_Data) {
+    unsigned long hsize;
+    int i, res;
+    FILE *fd;
+    char str[FTI_BUFS], *hdr;
+    if (FTI_Conf.directIO)
+    { // Aligned writes bypassing the page cache
+        res = FTI_Try(FTI_WriteDirect(fn, FTI_Data), "write the checkpoint with direct I/O.");
+        if (res != FTI_SCES) return FTI_NSCS;
+    } else if (FTI_Conf.ioThreads > 1)
+    { // Byte ranges written concurrently by the thread pool
+        res = FTI_Try(FTI_WriteThreads(fn, FTI_Data), "write the checkpoint with several threads.");
+        if (res != FTI_SCES) return FTI_NSCS;
+    } else if (FTI_Conf.ioMode == FTI_IO_VECT)
+    { // All datasets in one vectored write
+        res = FTI_Try(FTI_WriteVect(fn, FTI_Data), "write the checkpoint with vectored I/O.");
+        if (res != FTI_SCES) return FTI_NSCS;
+    } else {
+        fd = fopen(fn, "wb");
+        if (fd == NULL)
+        {
+            FTI_Print("FTI checkpoint file could not be opened.", FTI_EROR);
+            return FTI_NSCS;
+        }
+        hdr = FTI_TocBuild(FTI_Data, &hsize);
+        if (hdr == NULL || fwrite(hdr, 1, hsize, fd) != hsize)
+        {
+            FTI_Print("FTI checkpoint file header could not be written.", FTI_EROR);
+            free(hdr);
+            fclose(fd);
+            return FTI_NSCS;
+        }
+        free(hdr);
+        for(i = 0; i < FTI_Exec.nbVar; i++)
+        {
+            if (fwrite(FTI_Data[i].ptr, FTI_Data[i].eleSize, FTI_Data[i].count, fd) != FTI_Data[i].count)
+            {
+                sprintf(str, "Dataset #%d could not be written.", FTI_Data[i].id);
+                FTI_Print(str, FTI_EROR);
+                fclose(fd);
+                return FTI_NSCS;
+            }
+        }
+        if (fflush(fd) != 0)
+        {
+            FTI_Print("FTI checkpoint file could not be flushed.", FTI_EROR);
+            fclose(fd);
+            return FTI_NSCS;
+        }
+        if (fclose(fd) != 0)
+        {
+            FTI_Print("FTI checkpoint file could not be flushed.", FTI_EROR);
+            return FTI_NSCS;
+        }
+    }
+    return FTI_SCES;
+}
+
+
 /*-------------------------------------------------------------------------*/
 /**
     @brief      It writes the checkpoint data in the target file.
@@ -67,17 +141,29 @@ int FTI_UpdateIterTime() {
     @return     integer         FTI_SCES if successful.
 
     This function checks whether the checkpoint needs to be local or remote,
-    opens the target file and write dataset per dataset, the checkpoint data,
-    it finally flushes and closes the checkpoint file.
+    and writes the checkpoint file. In incremental mode, L1 checkpoints
+    only write the changed blocks in a delta file when possible. Compressed
+    checkpoints, and checkpoints with datasets having an error bound, are
+    written by FTI_WriteComp, except the L1 ones in incremental mode, which
+    can be the base of a delta chain. The other checkpoints are written by
+    FTI_WriteFull. For inline L2 and L3 checkpoints, FTI_WritePtner and
+    FTI_WriteRSenc also send the data to the partner or encode it while
+    the file is written, if no process of the group compresses. Full
+    checkpoint files start with a header and a table of contents
+    (FTI_TocBuild), which also records the CRC32C of each dataset for the
+    metadata. Delta files have their own header.
 
  **/
 /*-------------------------------------------------------------------------*/
 int FTI_WriteCkpt(FTIT_dataset* FTI_Data) {
-    int i, res;
-    FILE *fd;
+    int res, stream = 0;
     double tt = MPI_Wtime();
     char fn[FTI_BUFS], str[FTI_BUFS];
     snprintf(FTI_Exec.ckptFile, FTI_BUFS, "Ckpt%d-Rank%d.fti", FTI_Exec.ckptID, FTI_Topo.myRank);
+    FTI_Exec.incChain[0] = '\0';
+    FTI_Exec.nbStored = 0;
+    FTI_Exec.nbCrc = 0;
+    FTI_Exec.postDone = 0;
     if (FTI_Ckpt[4].isInline && FTI_Exec.ckptLvel == 4)
     {
         sprintf(fn,"%s/%s",FTI_Conf.gTmpDir, FTI_Exec.ckptFile);
@@ -86,30 +172,31 @@ int FTI_WriteCkpt(FTIT_dataset* FTI_Data) {
         sprintf(fn,"%s/%s",FTI_Conf.lTmpDir, FTI_Exec.ckptFile);
         mkdir(FTI_Conf.lTmpDir, 0777);
     }
-    fd = fopen(fn, "wb");
-    if (fd == NULL)
-    {
-        FTI_Print("FTI checkpoint file could not be opened.", FTI_EROR);
-        return FTI_NSCS;
+    if ((FTI_Exec.ckptLvel == 2 || (FTI_Exec.ckptLvel == 3 && !FTI_Conf.l3Xor)) &&
+        FTI_Ckpt[FTI_Exec.ckptLvel].isInline)
+    { // The whole group must stream, or none of it
+        stream = !FTI_CompCheck(FTI_Data);
+        MPI_Allreduce(MPI_IN_PLACE, &stream, 1, MPI_INT, MPI_MIN, FTI_Exec.groupComm);
     }
-    for(i = 0; i < FTI_Exec.nbVar; i++)
-    {
-        if (fwrite(FTI_Data[i].ptr, FTI_Data[i].eleSize, FTI_Data[i].count, fd) != FTI_Data[i].count)
-        {
-            sprintf(str, "Dataset #%d could not be written.", FTI_Data[i].id);
-            FTI_Print(str, FTI_EROR);
-            return FTI_NSCS;
-        }
-    }
-    if (fflush(fd) != 0)
-    {
-        FTI_Print("FTI checkpoint file could not be flushed.", FTI_EROR);
-        return FTI_NSCS;
-    }
-    if (fclose(fd) != 0)
-    {
-        FTI_Print("FTI checkpoint file could not be flushed.", FTI_EROR);
-        return FTI_NSCS;
+    if (FTI_Conf.incBlockSize && FTI_IncPrepare(FTI_Data) == FTI_SCES)
+    { // Only the blocks changed since the last checkpoint
+        res = FTI_Try(FTI_WriteDelta(fn, FTI_Data), "write the delta checkpoint.");
+        if (res != FTI_SCES) return FTI_NSCS;
+    } else if (FTI_CompCheck(FTI_Data) && !(FTI_Conf.incBlockSize && FTI_Exec.ckptLvel == 1))
+    { // Datasets compressed according to their type and error bound
+        res = FTI_Try(FTI_WriteComp(fn, FTI_Data), "write the compressed checkpoint.");
+        if (res != FTI_SCES) return FTI_NSCS;
+    } else if (stream && FTI_Exec.ckptLvel == 2)
+    { // Partner copy sent from memory while the file is written
+        res = FTI_Try(FTI_WritePtner(fn, FTI_Data), "write the checkpoint and its partner copy.");
+        if (res != FTI_SCES) return FTI_NSCS;
+    } else if (stream)
+    { // Encoded from memory while the file is written
+        res = FTI_Try(FTI_WriteRSenc(fn, FTI_Data), "write and encode the checkpoint.");
+        if (res != FTI_SCES) return FTI_NSCS;
+    } else {
+        res = FTI_Try(FTI_WriteFull(fn, FTI_Data), "write the checkpoint.");
+        if (res != FTI_SCES) return FTI_NSCS;
     }
     sprintf(str, "Time writing checkpoint file : %f seconds.", MPI_Wtime()-tt);
     FTI_Print(str, FTI_DBUG);
@@ -173,7 +260,7 @@ int FTI_PostCkpt(int group, int fo, int pr) {
     char str[FTI_BUFS];
     t0 = MPI_Wtime();
     res = (FTI_Exec.ckptLvel == (FTI_REJW-FTI_BASE)) ? FTI_NSCS : FTI_SCES;
-    MPI_Allreduce(&res, &tres, 1, MPI_INT, MPI_SUM, FTI_COMM_WORLD);
+    MPI_Allreduce(&res, &tres, 1, MPI_INT, MPI_SUM, FTI_Exec.postComm);
     if (tres != FTI_SCES)
     {
         FTI_GroupClean(0, group, pr);
@@ -183,12 +270,12 @@ int FTI_PostCkpt(int group, int fo, int pr) {
     for(i = 0; i < pr; i++) {
         switch(FTI_Exec.ckptLvel) {
             case 4 : res += FTI_Flush(i+group, fo); break;
-            case 3 : res += FTI_RSenc(i+group); break;
+            case 3 : res += FTI_Conf.l3Xor ? FTI_XORenc(i+group) : FTI_RSenc(i+group); break;
             case 2 : res += FTI_Ptner(i+group); break;
             case 1 : res += FTI_Local(i+group); break;
         }
     }
-    MPI_Allreduce(&res, &tres, 1, MPI_INT, MPI_SUM, FTI_COMM_WORLD);
+    MPI_Allreduce(&res, &tres, 1, MPI_INT, MPI_SUM, FTI_Exec.postComm);
     if (tres != FTI_SCES)
     {
         FTI_GroupClean(0, group, pr);
@@ -196,7 +283,7 @@ int FTI_PostCkpt(int group, int fo, int pr) {
     }
     t2 = MPI_Wtime();
     FTI_GroupClean(FTI_Exec.ckptLvel, group, pr);
-    MPI_Barrier(FTI_COMM_WORLD);
+    MPI_Barrier(FTI_Exec.postComm);
     nodeFlag = (((!FTI_Topo.amIaHead) && (FTI_Topo.nodeRank == 0)) || (FTI_Topo.amIaHead))? 1 : 0;
     if (nodeFlag)
     {
@@ -0,0 +1,734 @@
+/**
+ *  @file   compress.c
+ *  @author Leonardo A. Bautista Gomez (leobago@gmail.com)
+ *  @date   October, 2026
+ *  @brief  Checkpoint compression functions for the FTI library.
+ */
+
+
+#include "fti.h"
+#include <stdint.h>
+
+
+/** Codec storing the dataset as it is.                                    */
+#define FTI_CODEC_RAW   0
+/** Codec for double precision floating point datasets.                    */
+#define FTI_CODEC_FP64  1
+/** Codec for single precision floating point datasets.                    */
+#define FTI_CODEC_FP32  2
+/** Codec for 8 bytes integer datasets.                                    */
+#define FTI_CODEC_INT64 3
+/** Codec for 4 bytes integer datasets.                                    */
+#define FTI_CODEC_INT32 4
+/** Lossy codec quantizing values within an absolute error bound.          */
+#define FTI_CODEC_QABS  5
+/** Lossy codec truncating double mantissas within a relative error bound. */
+#define FTI_CODEC_TR64  6
+/** Lossy codec truncating float mantissas within a relative error bound.  */
+#define FTI_CODEC_TR32  7
+/** Number of codecs.                                                      */
+#define FTI_NB_CODECS   8
+
+
+/*-------------------------------------------------------------------------*/
+/** @typedef    FTIT_codec
+    @brief      Compression codec.
+
+    This type describes a codec working on the elements of a dataset. The
+    encoder returns the compressed size and the decoder the number of
+    compressed bytes consumed, or 0 if the stream is corrupted. Lossy codecs
+    also have a transform, which maps each element of the dataset to an
+    element of the given width within the error bound, and its inverse.
+*/
+/*-------------------------------------------------------------------------*/
+typedef struct FTIT_codec {             /** Compression codec.             */
+    int             width;              /** Element size in bytes.         */
+    unsigned long   (*enc)(unsigned char *src, unsigned long n, int w,
+                           unsigned char *dst);
+    unsigned long   (*dec)(unsigned char *src, unsigned long csize, int w,
+                           unsigned char *dst, unsigned long n);
+    int             (*fwd)(FTIT_dataset *data, double bound,
+                           unsigned char *dst);
+    int             (*inv)(FTIT_dataset *data, double bound,
+                           unsigned char *src);
+} FTIT_codec;
+
+
+/*-------------------------------------------------------------------------*/
+/**
+    @brief      It loads an element as an unsigned integer.
+    @param      p               Pointer to the element.
+    @param      w               Element size (4 or 8 bytes).
+    @return     uint64_t        Element value.
+
+ **/
+/*-------------------------------------------------------------------------*/
+static inline uint64_t FTI_Load(unsigned char *p, int w) {
+    uint32_t v32;
+    uint64_t v64;
+    if (w == 4)
+    {
+        memcpy(&v32, p, 4);
+        return v32;
+    }
+    memcpy(&v64, p, 8);
+    return v64;
+}
+
+
+/*-------------------------------------------------------------------------*/
+/**
+    @brief      It stores an unsigned integer as an element.
+    @param      p               Pointer to the element.
+    @param      v               Element value.
+    @param      w               Element size (4 or 8 bytes).
+    @return     void
+
+ **/
+/*-------------------------------------------------------------------------*/
+static inline void FTI_Store(unsigned char *p, uint64_t v, int w) {
+    uint32_t v32 = (uint32_t) v;
+    if (w == 4)
+    {
+        memcpy(p, &v32, 4);
+    } else {
+        memcpy(p, &v, 8);
+    }
+}
+
+
+/*-------------------------------------------------------------------------*/
+/**
+    @brief      It counts the leading zero bytes of an element.
+    @param      x               Element value.
+    @param      w               Element size (4 or 8 bytes).
+    @return     integer         Number of leading zero bytes (0 to w).
+
+ **/
+/*-------------------------------------------------------------------------*/
+static inline int FTI_ZeroBytes(uint64_t x, int w) {
+    if (x == 0) return w;
+#ifdef __GNUC__
+    return (__builtin_clzll(x) >> 3) - (8 - w);
+#else
+    int z = 0;
+    while (!(x >> (8*(w-1-z)))) z++;
+    return z;
+#endif
+}
+
+
+/*-------------------------------------------------------------------------*/
+/**
+    @brief      It compresses floating point elements.
+    @param      src             Elements to compress.
+    @param      n               Number of elements.
+    @param      w               Element size (4 or 8 bytes).
+    @param      dst             Buffer for the compressed stream.
+    @return     integer         Size of the compressed stream.
+
+    Each element is XORed with a prediction: the previous element, or the
+    linear extrapolation of the two previous ones, whichever leaves more
+    leading zero bytes. A 4 bits code (predictor and number of zero bytes)
+    is stored per element, two codes per byte, followed by the remaining
+    bytes of the two elements. For 8 bytes elements, 4 zero bytes is not
+    encodable and 3 are stored instead.
+
+ **/
+/*-------------------------------------------------------------------------*/
+unsigned long FTI_XorEnc(unsigned char *src, unsigned long n, int w, unsigned char *dst) {
+    uint64_t v, x, y, p1 = 0, p2 = 0, mask = (w == 8) ? ~0ULL : (1ULL << 32) - 1;
+    unsigned char *out = dst, *hdr = dst;
+    unsigned long i;
+    int z, zy, b, code;
+    for (i = 0; i < n; i++)
+    {
+        v = FTI_Load(src + i*w, w);
+        x = v ^ p1;
+        y = v ^ ((2*p1 - p2) & mask);
+        z = FTI_ZeroBytes(x, w);
+        zy = FTI_ZeroBytes(y, w);
+        code = 0;
+        if (zy > z)
+        { // Linear prediction is better
+            x = y;
+            z = zy;
+            code = 8;
+        }
+        if (w == 8 && z == 4) z = 3;
+        code = code | ((w == 8 && z > 4) ? z - 1 : z);
+        if (i % 2 == 0)
+        {
+            hdr = out++;
+            *hdr = code << 4;
+        } else {
+            *hdr = *hdr | code;
+        }
+        for (b = 0; b < w - z; b++)
+        {
+            *out++ = (x >> (8*b)) & 0xff;
+        }
+        p2 = p1;
+        p1 = v;
+    }
+    return out - dst;
+}
+
+
+/*-------------------------------------------------------------------------*/
+/**
+    @brief      It decompresses floating point elements.
+    @param      src             Compressed stream.
+    @param      csize           Size of the compressed stream.
+    @param      w               Element size (4 or 8 bytes).
+    @param      dst             Buffer for the elements.
+    @param      n               Number of elements.
+    @return     integer         Compressed bytes consumed, 0 if corrupted.
+
+    This function reverts FTI_XorEnc.
+
+ **/
+/*-------------------------------------------------------------------------*/
+unsigned long FTI_XorDec(unsigned char *src, unsigned long csize, int w, unsigned char *dst, unsigned long n) {
+    uint64_t v, x, p1 = 0, p2 = 0, mask = (w == 8) ? ~0ULL : (1ULL << 32) - 1;
+    unsigned char *in = src, *end = src + csize, hdr = 0;
+    unsigned long i;
+    int z, b, code;
+    for (i = 0; i < n; i++)
+    {
+        if (i % 2 == 0)
+        {
+            if (in >= end) return 0;
+            hdr = *in++;
+            code = hdr >> 4;
+        } else {
+            code = hdr & 0xf;
+        }
+        z = code & 7;
+        if (w == 8 && z > 3) z++;
+        if (z > w || in + (w - z) > end) return 0;
+        x = 0;
+        for (b = 0; b < w - z; b++)
+        {
+            x = x | ((uint64_t) *in++ << (8*b));
+        }
+        v = x ^ ((code & 8) ? (2*p1 - p2) & mask : p1);
+        FTI_Store(dst + i*w, v, w);
+        p2 = p1;
+        p1 = v;
+    }
+    return in - src;
+}
+
+
+/*-------------------------------------------------------------------------*/
+/**
+    @brief      It compresses integer elements.
+    @param      src             Elements to compress.
+    @param      n               Number of elements.
+    @param      w               Element size (4 or 8 bytes).
+    @param      dst             Buffer for the compressed stream.
+    @param      order           Order of the prediction (1 or 2).
+    @return     integer         Size of the compressed stream.
+
+    Each element is replaced by its difference with a prediction, zigzag
+    encoded so that small negative differences also have leading zero
+    bytes. The prediction is the previous element (order 1) or the linear
+    extrapolation of the two previous ones (order 2). The stream has the
+    same layout as for FTI_XorEnc, with the number of zero bytes as code.
+
+ **/
+/*-------------------------------------------------------------------------*/
+unsigned long FTI_DeltaCode(unsigned char *src, unsigned long n, int w, unsigned char *dst, int order) {
+    uint64_t v, d, p1 = 0, p2 = 0, mask = (w == 8) ? ~0ULL : (1ULL << 32) - 1;
+    unsigned char *out = dst, *hdr = dst;
+    unsigned long i;
+    int z, b;
+    for (i = 0; i < n; i++)
+    {
+        v = FTI_Load(src + i*w, w);
+        d = (v - ((order == 2) ? 2*p1 - p2 : p1)) & mask;
+        d = ((d << 1) ^ ((d >> (8*w - 1)) ? mask : 0)) & mask;
+        z = FTI_ZeroBytes(d, w);
+        if (i % 2 == 0)
+        {
+            hdr = out++;
+            *hdr = z << 4;
+        } else {
+            *hdr = *hdr | z;
+        }
+        for (b = 0; b < w - z; b++)
+        {
+            *out++ = (d >> (8*b)) & 0xff;
+        }
+        p2 = p1;
+        p1 = v;
+    }
+    return out - dst;
+}
+
+
+/*-------------------------------------------------------------------------*/
+/**
+    @brief      It decompresses integer elements.
+    @param      src             Compressed stream.
+    @param      csize           Size of the compressed stream.
+    @param      w               Element size (4 or 8 bytes).
+    @param      dst             Buffer for the elements.
+    @param      n               Number of elements.
+    @param      order           Order of the prediction (1 or 2).
+    @return     integer         Compressed bytes consumed, 0 if corrupted.
+
+    This function reverts FTI_DeltaCode.
+
+ **/
+/*-------------------------------------------------------------------------*/
+unsigned long FTI_DeltaDecode(unsigned char *src, unsigned long csize, int w, unsigned char *dst, unsigned long n, int order) {
+    uint64_t v, d, p1 = 0, p2 = 0, mask = (w == 8) ? ~0ULL : (1ULL << 32) - 1;
+    unsigned char *in = src, *end = src + csize, hdr = 0;
+    unsigned long i;
+    int z, b;
+    for (i = 0; i < n; i++)
+    {
+        if (i % 2 == 0)
+        {
+            if (in >= end) return 0;
+            hdr = *in++;
+            z = hdr >> 4;
+        } else {
+            z = hdr & 0xf;
+        }
+        if (z > w || in + (w - z) > end) return 0;
+        d = 0;
+        for (b = 0; b < w - z; b++)
+        {
+            d = d | ((uint64_t) *in++ << (8*b));
+        }
+        d = (d >> 1) ^ ((d & 1) ? mask : 0);
+        v = (((order == 2) ? 2*p1 - p2 : p1) + d) & mask;
+        FTI_Store(dst + i*w, v, w);
+        p2 = p1;
+        p1 = v;
+    }
+    return in - src;
+}
+
+
+/** Delta codecs with first and second order predictions.                  */
+unsigned long FTI_DeltaEnc(unsigned char *src, unsigned long n, int w, unsigned char *dst) {
+    return FTI_DeltaCode(src, n, w, dst, 1);
+}
+unsigned long FTI_DeltaDec(unsigned char *src, unsigned long csize, int w, unsigned char *dst, unsigned long n) {
+    return FTI_DeltaDecode(src, csize, w, dst, n, 1);
+}
+unsigned long FTI_Delta2Enc(unsigned char *src, unsigned long n, int w, unsigned char *dst) {
+    return FTI_DeltaCode(src, n, w, dst, 2);
+}
+unsigned long FTI_Delta2Dec(unsigned char *src, unsigned long csize, int w, unsigned char *dst, unsigned long n) {
+    return FTI_DeltaDecode(src, csize, w, dst, n, 2);
+}
+
+
+/*-------------------------------------------------------------------------*/
+/**
+    @brief      It quantizes a dataset within an absolute error bound.
+    @param      data            Dataset (doubles or floats).
+    @param      bound           Absolute error bound.
+    @param      dst             Buffer for the quantized values (int64).
+    @return     integer         FTI_SCES if successful.
+
+    Each value is replaced by the nearest multiple of twice the bound. The
+    reconstructed value is checked against the bound, and the function
+    fails if a value cannot be represented (too large, infinite or NaN).
+
+ **/
+/*-------------------------------------------------------------------------*/
+int FTI_QuantFwd(FTIT_dataset *data, double bound, unsigned char *dst) {
+    double v, r, step = 2*bound, err;
+    int64_t q;
+    long i;
+    for (i = 0; i < data->count; i++)
+    {
+        v = (data->eleSize == 8) ? ((double *) data->ptr)[i] : ((float *) data->ptr)[i];
+        r = v / step;
+        if (!(r < 4.0e18 && r > -4.0e18)) return FTI_NSCS; // Also false for NaN
+        q = (int64_t) ((r < 0) ? r - 0.5 : r + 0.5);
+        err = (data->eleSize == 8) ? q*step - v : (float) (q*step) - v;
+        if (err > bound || err < -bound) return FTI_NSCS;
+        memcpy(dst + i*8, &q, 8);
+    }
+    return FTI_SCES;
+}
+
+
+/*-------------------------------------------------------------------------*/
+/**
+    @brief      It reconstructs a quantized dataset.
+    @param      data            Dataset (doubles or floats).
+    @param      bound           Absolute error bound.
+    @param      src             Quantized values (int64).
+    @return     integer         FTI_SCES if successful.
+
+ **/
+/*-------------------------------------------------------------------------*/
+int FTI_QuantInv(FTIT_dataset *data, double bound, unsigned char *src) {
+    double step = 2*bound;
+    int64_t q;
+    long i;
+    for (i = 0; i < data->count; i++)
+    {
+        memcpy(&q, src + i*8, 8);
+        if (data->eleSize == 8)
+        {
+            ((double *) data->ptr)[i] = q*step;
+        } else {
+            ((float *) data->ptr)[i] = (float) (q*step);
+        }
+    }
+    return FTI_SCES;
+}
+
+
+/*-------------------------------------------------------------------------*/
+/**
+    @brief      It computes the mantissa bits dropped for a relative bound.
+    @param      bound           Relative error bound.
+    @param      bits            Number of bits of the mantissa.
+    @return     integer         Number of low mantissa bits to drop.
+
+    Keeping k bits of the mantissa bounds the relative error by 2^-k, so k
+    is the smallest number of bits such that 2^-k is below the bound.
+
+ **/
+/*-------------------------------------------------------------------------*/
+int FTI_TruncBits(double bound, int bits) {
+    double p = 1.0;
+    int k = 0;
+    while (p > bound && k < bits)
+    {
+        p = p / 2;
+        k++;
+    }
+    return bits - k;
+}
+
+
+/*-------------------------------------------------------------------------*/
+/**
+    @brief      It truncates the mantissas within a relative error bound.
+    @param      data            Dataset (doubles or floats).
+    @param      bound           Relative error bound.
+    @param      dst             Buffer for the truncated values.
+    @return     integer         FTI_SCES if successful.
+
+    The low bits of the mantissas are dropped and the remaining bits are
+    shifted down, so that the XOR codec removes them as leading zeros.
+
+ **/
+/*-------------------------------------------------------------------------*/
+int FTI_TruncFwd(FTIT_dataset *data, double bound, unsigned char *dst) {
+    int w = data->eleSize, s = FTI_TruncBits(bound, (w == 8) ? 52 : 23);
+    long i;
+    for (i = 0; i < data->count; i++)
+    {
+        FTI_Store(dst + i*w, FTI_Load((unsigned char *) data->ptr + i*w, w) >> s, w);
+    }
+    return FTI_SCES;
+}
+
+
+/*-------------------------------------------------------------------------*/
+/**
+    @brief      It reconstructs a dataset with truncated mantissas.
+    @param      data            Dataset (doubles or floats).
+    @param      bound           Relative error bound.
+    @param      src             Truncated values.
+    @return     integer         FTI_SCES if successful.
+
+ **/
+/*-------------------------------------------------------------------------*/
+int FTI_TruncInv(FTIT_dataset *data, double bound, unsigned char *src) {
+    int w = data->eleSize, s = FTI_TruncBits(bound, (w == 8) ? 52 : 23);
+    long i;
+    for (i = 0; i < data->count; i++)
+    {
+        FTI_Store((unsigned char *) data->ptr + i*w, FTI_Load(src + i*w, w) << s, w);
+    }
+    return FTI_SCES;
+}
+
+
+/** Codecs indexed by their ID, as stored in the metadata.                 */
+static FTIT_codec FTI_Codecs[FTI_NB_CODECS] = {
+    {1, NULL,          NULL,          NULL,         NULL        },
+    {8, FTI_XorEnc,    FTI_XorDec,    NULL,         NULL        },
+    {4, FTI_XorEnc,    FTI_XorDec,    NULL,         NULL        },
+    {8, FTI_DeltaEnc,  FTI_DeltaDec,  NULL,         NULL        },
+    {4, FTI_DeltaEnc,  FTI_DeltaDec,  NULL,         NULL        },
+    {8, FTI_Delta2Enc, FTI_Delta2Dec, FTI_QuantFwd, FTI_QuantInv},
+    {8, FTI_XorEnc,    FTI_XorDec,    FTI_TruncFwd, FTI_TruncInv},
+    {4, FTI_XorEnc,    FTI_XorDec,    FTI_TruncFwd, FTI_TruncInv}
+};
+
+
+/*-------------------------------------------------------------------------*/
+/**
+    @brief      It selects the codec of a dataset from its data type.
+    @param      data            Dataset.
+    @param      lossy           TRUE if the error bound can be used.
+    @return     integer         Codec ID.
+
+    Datasets with an error bound use a lossy codec. Otherwise, if
+    compression is enabled, floating point datasets use the XOR codecs and
+    integer datasets the delta codecs. Other types, including the ones
+    defined by the user, are not compressed.
+
+ **/
+/*-------------------------------------------------------------------------*/
+int FTI_CodecSelect(FTIT_dataset* data, int lossy) {
+    int id = data->type.id, size = data->type.size;
+    if (lossy && ((id == FTI_DBLE.id && size == 8) || (id == FTI_SFLT.id && size == 4)))
+    { // Error bounds only apply to floating point datasets
+        if (data->errMode == FTI_EABS) return FTI_CODEC_QABS;
+        if (data->errMode == FTI_EREL) return (size == 8) ? FTI_CODEC_TR64 : FTI_CODEC_TR32;
+    }
+    if (!FTI_Conf.compress) return FTI_CODEC_RAW;
+    if (id == FTI_DBLE.id && size == 8) return FTI_CODEC_FP64;
+    if (id == FTI_SFLT.id && size == 4) return FTI_CODEC_FP32;
+    if (id == FTI_INTG.id || id == FTI_UINT.id || id == FTI_LONG.id || id == FTI_ULNG.id)
+    {
+        if (size == 8) return FTI_CODEC_INT64;
+        if (size == 4) return FTI_CODEC_INT32;
+    }
+    return FTI_CODEC_RAW;
+}
+
+
+/*-------------------------------------------------------------------------*/
+/**
+    @brief      It tells whether the checkpoint has to be compressed.
+    @param      FTI_Data        Dataset array.
+    @return     integer         TRUE if FTI_WriteComp has to be used.
+
+    This function returns TRUE if compression is enabled or if at least
+    one dataset has an error bound.
+
+ **/
+/*-------------------------------------------------------------------------*/
+int FTI_CompCheck(FTIT_dataset* FTI_Data) {
+    int i;
+    if (FTI_Conf.compress) return 1;
+    for (i = 0; i < FTI_Exec.nbVar; i++)
+    {
+        if (FTI_Data[i].errMode) return 1;
+    }
+    return 0;
+}
+
+
+/*-------------------------------------------------------------------------*/
+/**
+    @brief      It grows a compression buffer.
+    @param      buf             Pointer to the buffer.
+    @param      max             Pointer to the size of the buffer.
+    @param      need            Size needed.
+    @return     integer         FTI_SCES if successful.
+
+ **/
+/*-------------------------------------------------------------------------*/
+int FTI_CompGrow(unsigned char **buf, unsigned long *max, unsigned long need) {
+    unsigned char *tmp;
+    if (need <= *max) return FTI_SCES;
+    tmp = realloc(*buf, need);
+    if (tmp == NULL)
+    {
+        FTI_Print("Compression buffer could not be allocated.", FTI_EROR);
+        return FTI_NSCS;
+    }
+    *buf = tmp;
+    *max = need;
+    return FTI_SCES;
+}
+
+
+/*-------------------------------------------------------------------------*/
+/**
+    @brief      It writes a compressed checkpoint file.
+    @param      fn              Name of the checkpoint file.
+    @param      FTI_Data        Dataset array.
+    @return     integer         FTI_SCES if successful.
+
+    This function compresses the datasets one by one with the codec of
+    their data type and writes them in the checkpoint file, after the space
+    left for the header, which is written at the end. Datasets with
+    an error bound are transformed first, and compressed losslessly if a
+    value cannot be stored within the bound. A dataset is stored as it is
+    if it does not get smaller. The codec, the stored size and the error
+    bound of each dataset are kept for the metadata, with the checksum of
+    the stored bytes.
+
+ **/
+/*-------------------------------------------------------------------------*/
+int FTI_WriteComp(char *fn, FTIT_dataset* FTI_Data) {
+    unsigned char *buf = NULL, *tbuf = NULL, *ptr, *src;
+    unsigned long max = 0, tmax = 0, n, tail, csize, total = 0, hsize;
+    char str[FTI_BUFS], *hdr;
+    FILE *fd;
+    int i, c, w;
+    fd = fopen(fn, "wb");
+    if (fd == NULL)
+    {
+        FTI_Print("FTI checkpoint file could not be opened.", FTI_EROR);
+        return FTI_NSCS;
+    }
+    if (fseek(fd, FTI_TocSize(FTI_Exec.nbVar), SEEK_SET) != 0)
+    {
+        FTI_Print("FTI checkpoint file could not be written.", FTI_EROR);
+        fclose(fd);
+        return FTI_NSCS;
+    }
+    for (i = 0; i < FTI_Exec.nbVar; i++)
+    {
+        ptr = (unsigned char *) FTI_Data[i].ptr;
+        c = FTI_CodecSelect(&FTI_Data[i], 1);
+        csize = FTI_Data[i].size;
+        if (FTI_Codecs[c].fwd != NULL)
+        { // Values within the error bound
+            w = FTI_Codecs[c].width;
+            if (FTI_CompGrow(&tbuf, &tmax, FTI_Data[i].count*w) != FTI_SCES) break;
+            if (FTI_Codecs[c].fwd(&FTI_Data[i], FTI_Data[i].errBound, tbuf) != FTI_SCES)
+            {
+                sprintf(str, "Dataset #%d cannot be stored within its error bound.", FTI_Data[i].id);
+                FTI_Print(str, FTI_DBUG);
+                c = FTI_CodecSelect(&FTI_Data[i], 0);
+            }
+        }
+        if (c != FTI_CODEC_RAW)
+        {
+            w = FTI_Codecs[c].width;
+            src = (FTI_Codecs[c].fwd != NULL) ? tbuf : ptr;
+            n = (FTI_Codecs[c].fwd != NULL) ? FTI_Data[i].count : FTI_Data[i].size / w;
+            tail = (FTI_Codecs[c].fwd != NULL) ? 0 : FTI_Data[i].size - n*w;
+            if (FTI_CompGrow(&buf, &max, n*w + n*w/8 + tail + 16) != FTI_SCES) break; // Worst case
+            csize = FTI_Codecs[c].enc(src, n, w, buf);
+            memcpy(buf + csize, ptr + n*w, tail);
+            csize = csize + tail;
+            if (csize >= FTI_Data[i].size)
+            { // Not worth it
+                c = FTI_CODEC_RAW;
+                csize = FTI_Data[i].size;
+            }
+        }
+        if (fwrite((c == FTI_CODEC_RAW) ? ptr : buf, 1, csize, fd) != csize)
+        {
+            sprintf(str, "Dataset #%d could not be written.", FTI_Data[i].id);
+            FTI_Print(str, FTI_EROR);
+            break;
+        }
+        FTI_Exec.varMeta[i].id = FTI_Data[i].id;
+        FTI_Exec.varMeta[i].codec = c;
+        FTI_Exec.varMeta[i].size = csize;
+        FTI_Exec.varMeta[i].bound = (FTI_Codecs[c].fwd != NULL) ? FTI_Data[i].errBound : 0;
+        if (FTI_Conf.ckptCrc)
+        { // Checksum of the stored bytes
+            FTI_Exec.crcMeta[i].size = csize;
+            FTI_Exec.crcMeta[i].crc = FTI_Crc32c(0, (c == FTI_CODEC_RAW) ? ptr : buf, csize);
+        }
+        total = total + csize;
+    }
+    free(buf);
+    free(tbuf);
+    if (i < FTI_Exec.nbVar)
+    {
+        fclose(fd);
+        return FTI_NSCS;
+    }
+    FTI_Exec.nbStored = FTI_Exec.nbVar;
+    if (FTI_Conf.ckptCrc) FTI_Exec.nbCrc = FTI_Exec.nbVar;
+    hdr = FTI_TocBuild(FTI_Data, &hsize);
+    if (hdr == NULL || fseek(fd, 0, SEEK_SET) != 0 || fwrite(hdr, 1, hsize, fd) != hsize)
+    {
+        FTI_Print("FTI checkpoint file header could not be written.", FTI_EROR);
+        free(hdr);
+        fclose(fd);
+        return FTI_NSCS;
+    }
+    free(hdr);
+    if (fflush(fd) != 0)
+    {
+        FTI_Print("FTI checkpoint file could not be flushed.", FTI_EROR);
+        fclose(fd);
+        return FTI_NSCS;
+    }
+    if (fclose(fd) != 0)
+    {
+        FTI_Print("FTI checkpoint file could not be flushed.", FTI_EROR);
+        return FTI_NSCS;
+    }
+    sprintf(str, "Checkpoint compressed from %u to %lu bytes.", FTI_Exec.ckptSize, total);
+    FTI_Print(str, FTI_DBUG);
+    return FTI_SCES;
+}
+
+
+/*-------------------------------------------------------------------------*/
+/**
+    @brief      It reads a dataset from a checkpoint file.
+    @param      fd              Checkpoint file, at the dataset offset.
+    @param      data            Protected dataset to fill.
+    @param      te              TOC entry of the dataset.
+    @return     integer         FTI_SCES if successful.
+
+    This function reads a dataset stored in a checkpoint file and
+    decompresses it directly in the protected buffer, with the codec given
+    by its TOC entry. Datasets stored with a lossy codec are rebuilt with
+    the error bound recorded at checkpoint time. The dataset must have the
+    size it had at checkpoint time.
+
+ **/
+/*-------------------------------------------------------------------------*/
+int FTI_ReadVar(FILE *fd, FTIT_dataset *data, FTIT_tocentry *te) {
+    unsigned char *buf = NULL, *tbuf = NULL, *ptr, *dst;
+    unsigned long max = 0, tmax = 0, n, tail, used;
+    FTIT_codec *cd;
+    char str[FTI_BUFS];
+    int w, res = FTI_SCES;
+    cd = (te->codec >= 0 && te->codec < FTI_NB_CODECS) ? &FTI_Codecs[te->codec] : NULL;
+    if (cd == NULL || (te->codec == FTI_CODEC_RAW && te->size != data->size) ||
+        (cd->fwd != NULL && data->eleSize != 8 && data->eleSize != 4) ||
+        (te->codec == FTI_CODEC_TR64 && data->eleSize != 8) ||
+        (te->codec == FTI_CODEC_TR32 && data->eleSize != 4))
+    {
+        sprintf(str, "Dataset #%d does not match the checkpoint.", te->id);
+        FTI_Print(str, FTI_EROR);
+        return FTI_NSCS;
+    }
+    ptr = (unsigned char *) data->ptr;
+    if (te->codec == FTI_CODEC_RAW)
+    {
+        return (fread(ptr, 1, te->size, fd) == te->size) ? FTI_SCES : FTI_NSCS;
+    }
+    w = cd->width;
+    n = (cd->fwd != NULL) ? data->count : data->size / w;
+    tail = (cd->fwd != NULL) ? 0 : data->size - n*w;
+    if (FTI_CompGrow(&buf, &max, te->size) != FTI_SCES) res = FTI_NSCS;
+    if (cd->fwd != NULL && FTI_CompGrow(&tbuf, &tmax, n*w) != FTI_SCES) res = FTI_NSCS;
+    if (res == FTI_SCES && fread(buf, 1, te->size, fd) != te->size) res = FTI_NSCS;
+    if (res == FTI_SCES)
+    {
+        dst = (cd->fwd != NULL) ? tbuf : ptr;
+        used = cd->dec(buf, te->size, w, dst, n);
+        if ((used == 0 && n > 0) || used + tail != te->size)
+        {
+            sprintf(str, "Dataset #%d could not be decompressed.", te->id);
+            FTI_Print(str, FTI_EROR);
+            res = FTI_NSCS;
+        } else {
+            memcpy(ptr + n*w, buf + used, tail);
+            if (cd->inv != NULL) res = cd->inv(data, te->bound, tbuf);
+        }
+    }
+    free(buf);
+    free(tbuf);
+    return res;
+}
@@ -95,6 +95,7 @@ int FTI_ReadConf(FTIT_injection *FTI_Inje) {
     snprintf(FTI_Conf.glbalDir, FTI_BUFS, "%s", par);
     par = iniparser_getstring(ini, "Basic:meta_dir", NULL);
     snprintf(FTI_Conf.metadDir, FTI_BUFS, "%s", par);
+    FTI_Ckpt[0].ckptIntv = (int) iniparser_getint(ini, "Basic:ckpt_l0", 0);
     FTI_Ckpt[1].ckptIntv = (int) iniparser_getint(ini, "Basic:ckpt_l1", -1);
     FTI_Ckpt[2].ckptIntv = (int) iniparser_getint(ini, "Basic:ckpt_l2", -1);
     FTI_Ckpt[3].ckptIntv = (int) iniparser_getint(ini, "Basic:ckpt_l3", -1);
@@ -110,7 +111,22 @@ int FTI_ReadConf(FTIT_injection *FTI_Inje) {
     FTI_Conf.blockSize = (int) iniparser_getint(ini, "Advanced:block_size", -1) * 1024;
     FTI_Conf.tag = (int) iniparser_getint(ini, "Advanced:mpi_tag", -1);
     FTI_Conf.test = (int) iniparser_getint(ini, "Advanced:local_test", -1);
-    FTI_Conf.l3WordSize = FTI_WORD;
+    FTI_Conf.l3WordSize = (int) iniparser_getint(ini, "Advanced:l3_word_size", FTI_WORD);
+    FTI_Conf.l3PacketSize = (int) iniparser_getint(ini, "Advanced:l3_packet_size", 0);
+    FTI_Conf.l3Reduce = (int) iniparser_getint(ini, "Advanced:l3_reduce_scatter", 0);
+    FTI_Conf.l3Threads = (int) iniparser_getint(ini, "Advanced:l3_threads", 1);
+    FTI_Conf.l3Parity = (int) iniparser_getint(ini, "Advanced:l3_parity", 0);
+    FTI_Conf.l3Xor = (int) iniparser_getint(ini, "Advanced:l3_xor_parity", 0);
+    FTI_Conf.ioMode = (int) iniparser_getint(ini, "Advanced:ckpt_io", FTI_IO_STDIO);
+    FTI_Conf.directIO = (int) iniparser_getint(ini, "Advanced:direct_io", 0);
+    FTI_Conf.ckptThread = (int) iniparser_getint(ini, "Advanced:ckpt_thread", 0);
+    FTI_Conf.incBlockSize = (int) iniparser_getint(ini, "Advanced:inc_block_size", 0) * 1024;
+    FTI_Conf.incMaxDeltas = (int) iniparser_getint(ini, "Advanced:inc_max_deltas", 8);
+    FTI_Conf.compress = (int) iniparser_getint(ini, "Advanced:ckpt_compress", 0);
+    FTI_Conf.ioThreads = (int) iniparser_getint(ini, "Advanced:io_threads", 1);
+    FTI_Conf.ckptCrc = (int) iniparser_getint(ini, "Advanced:ckpt_crc", 1);
+    FTI_Conf.mmapRestart = (int) iniparser_getint(ini, "Advanced:mmap_restart", 0);
+    FTI_Conf.pipeDepth = (int) iniparser_getint(ini, "Advanced:pipeline_depth", 4);
 
     // Reading/setting execution metadata
     FTI_Exec.nbVar = 0;
@@ -222,11 +238,104 @@ int FTI_TestConfig() {
         FTI_Print("Keep last ckpt. needs to be set to 0 or 1.", FTI_WARN);
         return FTI_NSCS;
     }
+    if (FTI_Conf.ioMode != FTI_IO_STDIO && FTI_Conf.ioMode != FTI_IO_VECT)
+    {
+        FTI_Print("Ckpt. I/O mode needs to be set to 0 or 1.", FTI_WARN);
+        return FTI_NSCS;
+    }
+    if (FTI_Conf.directIO != 0 && FTI_Conf.directIO != 1)
+    {
+        FTI_Print("Direct I/O needs to be set to 0 or 1.", FTI_WARN);
+        return FTI_NSCS;
+    }
+    if (FTI_Conf.ckptThread != 0 && FTI_Conf.ckptThread != 1)
+    {
+        FTI_Print("Ckpt. thread needs to be set to 0 or 1.", FTI_WARN);
+        return FTI_NSCS;
+    }
+    if (FTI_Conf.ckptThread && FTI_Topo.nbHeads != 0)
+    {
+        FTI_Print("If ckpt. thread is set to 1 then head should be set to 0.", FTI_WARN);
+        return FTI_NSCS;
+    }
+    if (FTI_Conf.incBlockSize < 0)
+    {
+        FTI_Print("Inc. block size needs to be set to 0 or more.", FTI_WARN);
+        return FTI_NSCS;
+    }
+    if (FTI_Conf.incMaxDeltas > 16 || FTI_Conf.incMaxDeltas < 1)
+    {
+        FTI_Print("Inc. max. deltas needs to be set between 1 and 16.", FTI_WARN);
+        return FTI_NSCS;
+    }
+    if (FTI_Conf.compress != 0 && FTI_Conf.compress != 1)
+    {
+        FTI_Print("Ckpt. compress needs to be set to 0 or 1.", FTI_WARN);
+        return FTI_NSCS;
+    }
+    if (FTI_Conf.ioThreads < 1 || FTI_Conf.ioThreads > 256)
+    {
+        FTI_Print("I/O threads needs to be set between 1 and 256.", FTI_WARN);
+        return FTI_NSCS;
+    }
+    if (FTI_Conf.ckptCrc != 0 && FTI_Conf.ckptCrc != 1)
+    {
+        FTI_Print("Ckpt. CRC needs to be set to 0 or 1.", FTI_WARN);
+        return FTI_NSCS;
+    }
+    if (FTI_Conf.mmapRestart != 0 && FTI_Conf.mmapRestart != 1)
+    {
+        FTI_Print("Mmap restart needs to be set to 0 or 1.", FTI_WARN);
+        return FTI_NSCS;
+    }
+    if (FTI_Conf.mmapRestart && FTI_Conf.ckptCrc)
+    { // The checksums would read the whole file before anything is mapped
+        FTI_Print("Mmap restart needs Ckpt_crc to be set to 0.", FTI_WARN);
+        return FTI_NSCS;
+    }
+    if (FTI_Conf.l3WordSize != 8 && FTI_Conf.l3WordSize != 16 && FTI_Conf.l3WordSize != 32)
+    {
+        FTI_Print("L3 word size needs to be set to 8, 16 or 32.", FTI_WARN);
+        return FTI_NSCS;
+    }
+    if (FTI_Conf.l3PacketSize < 0 || FTI_Conf.l3PacketSize % 8 != 0 ||
+        (FTI_Conf.l3PacketSize > 0 && FTI_Conf.blockSize % (FTI_Conf.l3WordSize*FTI_Conf.l3PacketSize) != 0))
+    {
+        FTI_Print("L3 packet size needs to be 0 or a multiple of 8 dividing the block size by the word size.", FTI_WARN);
+        return FTI_NSCS;
+    }
+    if (FTI_Conf.l3Reduce != 0 && FTI_Conf.l3Reduce != 1)
+    {
+        FTI_Print("L3 reduce-scatter needs to be set to 0 or 1.", FTI_WARN);
+        return FTI_NSCS;
+    }
+    if (FTI_Conf.l3Threads < 1 || FTI_Conf.l3Threads > 256)
+    {
+        FTI_Print("L3 threads needs to be set between 1 and 256.", FTI_WARN);
+        return FTI_NSCS;
+    }
+    if (FTI_Conf.l3Parity == 0) FTI_Conf.l3Parity = FTI_Topo.groupSize;
+    if (FTI_Conf.l3Parity < 1 || FTI_Conf.l3Parity > FTI_Topo.groupSize)
+    {
+        FTI_Print("L3 parity needs to be set between 1 and the group size, or 0.", FTI_WARN);
+        return FTI_NSCS;
+    }
+    if (FTI_Conf.l3Xor != 0 && FTI_Conf.l3Xor != 1)
+    {
+        FTI_Print("L3 XOR parity needs to be set to 0 or 1.", FTI_WARN);
+        return FTI_NSCS;
+    }
+    if (FTI_Conf.pipeDepth < 1 || FTI_Conf.pipeDepth > 64)
+    {
+        FTI_Print("Pipeline depth needs to be set between 1 and 64.", FTI_WARN);
+        return FTI_NSCS;
+    }
     int l;
     for (l = 1; l < 5; l++)
     {
         if (FTI_Ckpt[l].ckptIntv == 0) FTI_Ckpt[l].ckptIntv = -1;
         if (FTI_Ckpt[l].isInline != 0 && FTI_Ckpt[l].isInline != 1) FTI_Ckpt[l].isInline = 1;
+        if (FTI_Conf.ckptThread) FTI_Ckpt[l].isInline = 1; // Post-processing done by the thread
         if (FTI_Ckpt[l].isInline == 0 && FTI_Topo.nbHeads != 1)
         {
             FTI_Print("If inline is set to 0 then head should be set to 1.", FTI_WARN);
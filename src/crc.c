@@ -0,0 +1,250 @@
+/**
+ *  @file   crc.c
+ *  @author Leonardo A. Bautista Gomez (leobago@gmail.com)
+ *  @date   October, 2026
+ *  @brief  CRC32C checksums of the checkpoint files for the FTI library.
+ */
+
+
+#include "fti.h"
+#include <stdint.h>
+#include <pthread.h>
+
+#if defined(__x86_64__) && defined(__GNUC__)
+#include <nmmintrin.h>
+#define FTI_CRC_HW 1
+#endif
+
+
+/** Reflected CRC32C (Castagnoli) polynomial.                              */
+#define FTI_CRC_POLY    0x82F63B78
+
+/** Slice-by-8 lookup tables, built at first use.                          */
+static uint32_t            FTI_CrcTable[8][256];
+static pthread_once_t      FTI_CrcOnce = PTHREAD_ONCE_INIT;
+
+/** TRUE if the processor has the SSE4.2 CRC32 instruction.                */
+static int                 FTI_CrcHw = 0;
+
+
+/*-------------------------------------------------------------------------*/
+/**
+    @brief      It builds the slice-by-8 tables and detects SSE4.2.
+    @return     void
+
+    This function is run once, by the first thread computing a checksum.
+
+ **/
+/*-------------------------------------------------------------------------*/
+void FTI_CrcInit() {
+    uint32_t c;
+    int i, j;
+    for (i = 0; i < 256; i++)
+    {
+        c = i;
+        for (j = 0; j < 8; j++)
+        {
+            c = (c & 1) ? (c >> 1) ^ FTI_CRC_POLY : c >> 1;
+        }
+        FTI_CrcTable[0][i] = c;
+    }
+    for (i = 0; i < 256; i++)
+    {
+        for (j = 1; j < 8; j++)
+        {
+            c = FTI_CrcTable[j-1][i];
+            FTI_CrcTable[j][i] = (c >> 8) ^ FTI_CrcTable[0][c & 0xFF];
+        }
+    }
+#ifdef FTI_CRC_HW
+    __builtin_cpu_init();
+    FTI_CrcHw = __builtin_cpu_supports("sse4.2");
+#endif
+}
+
+
+#ifdef FTI_CRC_HW
+/*-------------------------------------------------------------------------*/
+/**
+    @brief      It updates a CRC32C with the SSE4.2 instruction.
+    @param      crc             Current CRC (not inverted).
+    @param      p               Data to add.
+    @param      len             Size of the data.
+    @return     integer         Updated CRC.
+
+    This function processes 8 bytes per instruction once the pointer is
+    aligned, and the unaligned head and tail byte by byte.
+
+ **/
+/*-------------------------------------------------------------------------*/
+__attribute__((target("sse4.2")))
+uint32_t FTI_CrcSse(uint32_t crc, const unsigned char *p, unsigned long len) {
+    uint64_t c;
+    while (len > 0 && ((uintptr_t) p & 7) != 0)
+    {
+        crc = _mm_crc32_u8(crc, *p++);
+        len--;
+    }
+    c = crc;
+    while (len >= 8)
+    {
+        c = _mm_crc32_u64(c, *(const uint64_t *) p);
+        p = p + 8;
+        len = len - 8;
+    }
+    crc = (uint32_t) c;
+    while (len > 0)
+    {
+        crc = _mm_crc32_u8(crc, *p++);
+        len--;
+    }
+    return crc;
+}
+#endif
+
+
+/*-------------------------------------------------------------------------*/
+/**
+    @brief      It updates a CRC32C with the slice-by-8 tables.
+    @param      crc             Current CRC (not inverted).
+    @param      p               Data to add.
+    @param      len             Size of the data.
+    @return     integer         Updated CRC.
+
+    This function is the portable version, processing 8 bytes per step with
+    eight table lookups (little endian byte order).
+
+ **/
+/*-------------------------------------------------------------------------*/
+uint32_t FTI_CrcSlice(uint32_t crc, const unsigned char *p, unsigned long len) {
+    uint32_t lo, hi;
+    while (len > 0 && ((uintptr_t) p & 7) != 0)
+    {
+        crc = (crc >> 8) ^ FTI_CrcTable[0][(crc ^ *p++) & 0xFF];
+        len--;
+    }
+    while (len >= 8)
+    {
+        lo = crc ^ ((uint32_t) p[0] | (uint32_t) p[1] << 8 | (uint32_t) p[2] << 16 | (uint32_t) p[3] << 24);
+        hi = (uint32_t) p[4] | (uint32_t) p[5] << 8 | (uint32_t) p[6] << 16 | (uint32_t) p[7] << 24;
+        crc = FTI_CrcTable[7][lo & 0xFF] ^ FTI_CrcTable[6][(lo >> 8) & 0xFF] ^
+              FTI_CrcTable[5][(lo >> 16) & 0xFF] ^ FTI_CrcTable[4][lo >> 24] ^
+              FTI_CrcTable[3][hi & 0xFF] ^ FTI_CrcTable[2][(hi >> 8) & 0xFF] ^
+              FTI_CrcTable[1][(hi >> 16) & 0xFF] ^ FTI_CrcTable[0][hi >> 24];
+        p = p + 8;
+        len = len - 8;
+    }
+    while (len > 0)
+    {
+        crc = (crc >> 8) ^ FTI_CrcTable[0][(crc ^ *p++) & 0xFF];
+        len--;
+    }
+    return crc;
+}
+
+
+/*-------------------------------------------------------------------------*/
+/**
+    @brief      It computes the CRC32C of a buffer.
+    @param      crc             CRC of the previous data, 0 to start.
+    @param      buf             Data to add.
+    @param      len             Size of the data.
+    @return     integer         CRC32C of the previous data and the buffer.
+
+    This function uses the SSE4.2 CRC32 instruction when the processor has
+    it, and the slice-by-8 tables otherwise. Both give the same result, so
+    the checkpoints can be checked on any node.
+
+ **/
+/*-------------------------------------------------------------------------*/
+unsigned int FTI_Crc32c(unsigned int crc, void *buf, unsigned long len) {
+    pthread_once(&FTI_CrcOnce, FTI_CrcInit);
+    crc = ~crc;
+#ifdef FTI_CRC_HW
+    if (FTI_CrcHw) return ~FTI_CrcSse(crc, (const unsigned char *) buf, len);
+#endif
+    return ~FTI_CrcSlice(crc, (const unsigned char *) buf, len);
+}
+
+
+/*-------------------------------------------------------------------------*/
+/**
+    @brief      It computes the checksums of the datasets.
+    @param      FTI_Data        Dataset array.
+    @return     integer         FTI_SCES if successful.
+
+    This function computes the CRC32C of each dataset, as written one after
+    the other in a checkpoint file, and keeps them for the metadata.
+
+ **/
+/*-------------------------------------------------------------------------*/
+int FTI_CrcData(FTIT_dataset* FTI_Data) {
+    int i;
+    for (i = 0; i < FTI_Exec.nbVar; i++)
+    {
+        FTI_Exec.crcMeta[i].size = FTI_Data[i].size;
+        FTI_Exec.crcMeta[i].crc = FTI_Crc32c(0, FTI_Data[i].ptr, FTI_Data[i].size);
+    }
+    FTI_Exec.nbCrc = FTI_Exec.nbVar;
+    return FTI_SCES;
+}
+
+
+/*-------------------------------------------------------------------------*/
+/**
+    @brief      It checks the content of a checkpoint file.
+    @param      fn              Name of the checkpoint file.
+    @param      fs              Size of the checkpoint file.
+    @param      nb              Number of parts with a checksum.
+    @param      cm              Size and checksum of each part.
+    @return     integer         FTI_SCES if the file is intact.
+
+    This function reads the checkpoint file and compares the CRC32C of each
+    part (one per dataset) with the one in the metadata. The header of the
+    file, if any, is checked by its own CRC and the parts follow it. Files
+    without checksums, or whose parts do not fit the file, are not checked.
+
+ **/
+/*-------------------------------------------------------------------------*/
+int FTI_CrcCheck(char *fn, unsigned long fs, unsigned int nb, FTIT_crcmeta *cm) {
+    unsigned long bs = FTI_Conf.blockSize, total = 0, left, len;
+    FTIT_tocentry toc[FTI_BUFS];
+    FTIT_tocheader hdr;
+    unsigned int crc, v;
+    char str[FTI_BUFS], *buf;
+    FILE *fd;
+    for (v = 0; v < nb; v++) total = total + cm[v].size;
+    if (nb == 0 || total > fs) return FTI_SCES;
+    fd = fopen(fn, "rb");
+    if (fd == NULL) return FTI_NSCS;
+    if (total < fs && (FTI_TocRead(fd, &hdr, toc) != 1 || hdr.dataOff != fs - total ||
+                       fseek(fd, hdr.dataOff, SEEK_SET) != 0))
+    {
+        sprintf(str, "Header of %s does not match the metadata.", fn);
+        FTI_Print(str, FTI_WARN);
+        fclose(fd);
+        return FTI_NSCS;
+    }
+    buf = talloc(char, bs);
+    for (v = 0; v < nb; v++)
+    {
+        crc = 0;
+        left = cm[v].size;
+        while (left > 0)
+        {
+            len = (left < bs) ? left : bs;
+            if (fread(buf, 1, len, fd) != len) break;
+            crc = FTI_Crc32c(crc, buf, len);
+            left = left - len;
+        }
+        if (left > 0 || crc != cm[v].crc)
+        {
+            sprintf(str, "Checksum mismatch in part %u of %s.", v, fn);
+            FTI_Print(str, FTI_WARN);
+            break;
+        }
+    }
+    free(buf);
+    fclose(fd);
+    return (v == nb) ? FTI_SCES : FTI_NSCS;
+}
@@ -39,6 +39,11 @@ plank@cs.utk.edu
 
 #include "galois.h"
 
+#if defined(__x86_64__) && defined(__GNUC__)
+#include <immintrin.h>
+#define GALOIS_SIMD 1
+#endif
+
 #define NONE (10)
 #define TABLE (11)
 #define SHIFT (12)
@@ -412,6 +417,316 @@ int galois_multtable_divide(int x, int y, int w)
   return galois_div_tables[w][(x<<w)|y];
 }
 
+#ifdef GALOIS_SIMD
+/* Split-nibble kernels for w = 8 and w = 16.  The product of a word by
+   multby is the xor of the products of its nibbles, so it is given by small
+   tables of 16 bytes (for w = 16, the low and high byte of the product for
+   each of the four nibble positions), looked up 16 bytes at a time with
+   PSHUFB.  The results are the same as with the multiplication and log
+   tables. */
+
+static int galois_simd = -1;   /* 0 none, 1 SSSE3, 2 AVX2, 3 AVX-512BW */
+
+static void galois_simd_init()
+{
+  __builtin_cpu_init();
+  if (__builtin_cpu_supports("avx512bw")) galois_simd = 3;
+  else if (__builtin_cpu_supports("avx2")) galois_simd = 2;
+  else if (__builtin_cpu_supports("ssse3")) galois_simd = 1;
+  else galois_simd = 0;
+}
+
+__attribute__((target("ssse3")))
+static void galois_w08_region_ssse3(unsigned char *src, unsigned char *dst, int nbytes,
+                                    unsigned char *tab, int add)
+{
+  __m128i mask, t0, t1, x, r;
+  int i;
+
+  mask = _mm_set1_epi8(0x0f);
+  t0 = _mm_loadu_si128((__m128i *) tab);
+  t1 = _mm_loadu_si128((__m128i *) (tab + 16));
+  for (i = 0; i < nbytes; i += 16) {
+    x = _mm_loadu_si128((__m128i *) (src + i));
+    r = _mm_xor_si128(_mm_shuffle_epi8(t0, _mm_and_si128(x, mask)),
+                      _mm_shuffle_epi8(t1, _mm_and_si128(_mm_srli_epi64(x, 4), mask)));
+    if (add) r = _mm_xor_si128(r, _mm_loadu_si128((__m128i *) (dst + i)));
+    _mm_storeu_si128((__m128i *) (dst + i), r);
+  }
+}
+
+__attribute__((target("avx2")))
+static void galois_w08_region_avx2(unsigned char *src, unsigned char *dst, int nbytes,
+                                   unsigned char *tab, int add)
+{
+  __m256i mask, t0, t1, x, r;
+  int i;
+
+  mask = _mm256_set1_epi8(0x0f);
+  t0 = _mm256_broadcastsi128_si256(_mm_loadu_si128((__m128i *) tab));
+  t1 = _mm256_broadcastsi128_si256(_mm_loadu_si128((__m128i *) (tab + 16)));
+  for (i = 0; i < nbytes; i += 32) {
+    x = _mm256_loadu_si256((__m256i *) (src + i));
+    r = _mm256_xor_si256(_mm256_shuffle_epi8(t0, _mm256_and_si256(x, mask)),
+                         _mm256_shuffle_epi8(t1, _mm256_and_si256(_mm256_srli_epi64(x, 4), mask)));
+    if (add) r = _mm256_xor_si256(r, _mm256_loadu_si256((__m256i *) (dst + i)));
+    _mm256_storeu_si256((__m256i *) (dst + i), r);
+  }
+}
+
+__attribute__((target("avx512f,avx512bw")))
+static void galois_w08_region_avx512(unsigned char *src, unsigned char *dst, int nbytes,
+                                     unsigned char *tab, int add)
+{
+  __m512i mask, t0, t1, x, r;
+  int i;
+
+  mask = _mm512_set1_epi8(0x0f);
+  t0 = _mm512_broadcast_i32x4(_mm_loadu_si128((__m128i *) tab));
+  t1 = _mm512_broadcast_i32x4(_mm_loadu_si128((__m128i *) (tab + 16)));
+  for (i = 0; i < nbytes; i += 64) {
+    x = _mm512_loadu_si512((void *) (src + i));
+    r = _mm512_xor_si512(_mm512_shuffle_epi8(t0, _mm512_and_si512(x, mask)),
+                         _mm512_shuffle_epi8(t1, _mm512_and_si512(_mm512_srli_epi64(x, 4), mask)));
+    if (add) r = _mm512_xor_si512(r, _mm512_loadu_si512((void *) (dst + i)));
+    _mm512_storeu_si512((void *) (dst + i), r);
+  }
+}
+
+/* Multiplies the largest prefix of the region that the best kernel of the
+   processor can handle, and returns its size in bytes (0 if none).  The
+   multiplication tables of w = 8 must exist. */
+
+static int galois_w08_region_simd(unsigned char *src, unsigned char *dst, int nbytes,
+                                  int multby, int add)
+{
+  unsigned char tab[32];
+  int done, v;
+
+  if (galois_simd < 0) galois_simd_init();
+  if (galois_simd == 0) return 0;
+  done = nbytes & ~((8 << galois_simd) - 1);
+  if (done == 0) return 0;
+  for (v = 0; v < 16; v++) {
+    tab[v] = galois_mult_tables[8][multby*nw[8]+v];
+    tab[v+16] = galois_mult_tables[8][multby*nw[8]+(v << 4)];
+  }
+  switch (galois_simd) {
+    case 3: galois_w08_region_avx512(src, dst, done, tab, add); break;
+    case 2: galois_w08_region_avx2(src, dst, done, tab, add); break;
+    default: galois_w08_region_ssse3(src, dst, done, tab, add); break;
+  }
+  return done;
+}
+
+/* For w = 16, the low and high bytes of the words are separated before the
+   lookups and interleaved back after them, so the region keeps the layout
+   of the log-table version. */
+
+static void galois_w16_nibble_tables(int multby, unsigned char *tlo, unsigned char *thi)
+{
+  int p, v, prod;
+
+  for (p = 0; p < 4; p++) {
+    for (v = 0; v < 16; v++) {
+      prod = galois_logtable_multiply(v << (4*p), multby, 16);
+      tlo[p*16+v] = prod & 0xff;
+      thi[p*16+v] = (prod >> 8) & 0xff;
+    }
+  }
+}
+
+__attribute__((target("ssse3")))
+static void galois_w16_region_ssse3(unsigned char *src, unsigned char *dst, int nbytes,
+                                    unsigned char *tlo, unsigned char *thi, int add)
+{
+  __m128i split, mask, lo, hi, a, b, rlo, rhi, n, t[8];
+  int i;
+
+  split = _mm_setr_epi8(0, 2, 4, 6, 8, 10, 12, 14, 1, 3, 5, 7, 9, 11, 13, 15);
+  mask = _mm_set1_epi8(0x0f);
+  for (i = 0; i < 4; i++) {
+    t[i] = _mm_loadu_si128((__m128i *) (tlo + 16*i));
+    t[i+4] = _mm_loadu_si128((__m128i *) (thi + 16*i));
+  }
+  for (i = 0; i < nbytes; i += 32) {
+    a = _mm_shuffle_epi8(_mm_loadu_si128((__m128i *) (src + i)), split);
+    b = _mm_shuffle_epi8(_mm_loadu_si128((__m128i *) (src + i + 16)), split);
+    lo = _mm_unpacklo_epi64(a, b);
+    hi = _mm_unpackhi_epi64(a, b);
+    n = _mm_and_si128(lo, mask);
+    rlo = _mm_shuffle_epi8(t[0], n);
+    rhi = _mm_shuffle_epi8(t[4], n);
+    n = _mm_and_si128(_mm_srli_epi64(lo, 4), mask);
+    rlo = _mm_xor_si128(rlo, _mm_shuffle_epi8(t[1], n));
+    rhi = _mm_xor_si128(rhi, _mm_shuffle_epi8(t[5], n));
+    n = _mm_and_si128(hi, mask);
+    rlo = _mm_xor_si128(rlo, _mm_shuffle_epi8(t[2], n));
+    rhi = _mm_xor_si128(rhi, _mm_shuffle_epi8(t[6], n));
+    n = _mm_and_si128(_mm_srli_epi64(hi, 4), mask);
+    rlo = _mm_xor_si128(rlo, _mm_shuffle_epi8(t[3], n));
+    rhi = _mm_xor_si128(rhi, _mm_shuffle_epi8(t[7], n));
+    a = _mm_unpacklo_epi8(rlo, rhi);
+    b = _mm_unpackhi_epi8(rlo, rhi);
+    if (add) {
+      a = _mm_xor_si128(a, _mm_loadu_si128((__m128i *) (dst + i)));
+      b = _mm_xor_si128(b, _mm_loadu_si128((__m128i *) (dst + i + 16)));
+    }
+    _mm_storeu_si128((__m128i *) (dst + i), a);
+    _mm_storeu_si128((__m128i *) (dst + i + 16), b);
+  }
+}
+
+/* The 256 and 512-bit shuffles and unpacks work within 128-bit lanes, so
+   each lane holds the low (or high) bytes of words of both inputs, and the
+   unpacks at the end give the words back in their original order. */
+
+__attribute__((target("avx2")))
+static void galois_w16_region_avx2(unsigned char *src, unsigned char *dst, int nbytes,
+                                   unsigned char *tlo, unsigned char *thi, int add)
+{
+  __m256i split, mask, lo, hi, a, b, rlo, rhi, n, t[8];
+  int i;
+
+  split = _mm256_setr_epi8(0, 2, 4, 6, 8, 10, 12, 14, 1, 3, 5, 7, 9, 11, 13, 15,
+                           0, 2, 4, 6, 8, 10, 12, 14, 1, 3, 5, 7, 9, 11, 13, 15);
+  mask = _mm256_set1_epi8(0x0f);
+  for (i = 0; i < 4; i++) {
+    t[i] = _mm256_broadcastsi128_si256(_mm_loadu_si128((__m128i *) (tlo + 16*i)));
+    t[i+4] = _mm256_broadcastsi128_si256(_mm_loadu_si128((__m128i *) (thi + 16*i)));
+  }
+  for (i = 0; i < nbytes; i += 64) {
+    a = _mm256_shuffle_epi8(_mm256_loadu_si256((__m256i *) (src + i)), split);
+    b = _mm256_shuffle_epi8(_mm256_loadu_si256((__m256i *) (src + i + 32)), split);
+    lo = _mm256_unpacklo_epi64(a, b);
+    hi = _mm256_unpackhi_epi64(a, b);
+    n = _mm256_and_si256(lo, mask);
+    rlo = _mm256_shuffle_epi8(t[0], n);
+    rhi = _mm256_shuffle_epi8(t[4], n);
+    n = _mm256_and_si256(_mm256_srli_epi64(lo, 4), mask);
+    rlo = _mm256_xor_si256(rlo, _mm256_shuffle_epi8(t[1], n));
+    rhi = _mm256_xor_si256(rhi, _mm256_shuffle_epi8(t[5], n));
+    n = _mm256_and_si256(hi, mask);
+    rlo = _mm256_xor_si256(rlo, _mm256_shuffle_epi8(t[2], n));
+    rhi = _mm256_xor_si256(rhi, _mm256_shuffle_epi8(t[6], n));
+    n = _mm256_and_si256(_mm256_srli_epi64(hi, 4), mask);
+    rlo = _mm256_xor_si256(rlo, _mm256_shuffle_epi8(t[3], n));
+    rhi = _mm256_xor_si256(rhi, _mm256_shuffle_epi8(t[7], n));
+    a = _mm256_unpacklo_epi8(rlo, rhi);
+    b = _mm256_unpackhi_epi8(rlo, rhi);
+    if (add) {
+      a = _mm256_xor_si256(a, _mm256_loadu_si256((__m256i *) (dst + i)));
+      b = _mm256_xor_si256(b, _mm256_loadu_si256((__m256i *) (dst + i + 32)));
+    }
+    _mm256_storeu_si256((__m256i *) (dst + i), a);
+    _mm256_storeu_si256((__m256i *) (dst + i + 32), b);
+  }
+}
+
+__attribute__((target("avx512f,avx512bw")))
+static void galois_w16_region_avx512(unsigned char *src, unsigned char *dst, int nbytes,
+                                     unsigned char *tlo, unsigned char *thi, int add)
+{
+  __m512i split, mask, lo, hi, a, b, rlo, rhi, n, t[8];
+  int i;
+
+  split = _mm512_broadcast_i32x4(_mm_setr_epi8(0, 2, 4, 6, 8, 10, 12, 14, 1, 3, 5, 7, 9, 11, 13, 15));
+  mask = _mm512_set1_epi8(0x0f);
+  for (i = 0; i < 4; i++) {
+    t[i] = _mm512_broadcast_i32x4(_mm_loadu_si128((__m128i *) (tlo + 16*i)));
+    t[i+4] = _mm512_broadcast_i32x4(_mm_loadu_si128((__m128i *) (thi + 16*i)));
+  }
+  for (i = 0; i < nbytes; i += 128) {
+    a = _mm512_shuffle_epi8(_mm512_loadu_si512((void *) (src + i)), split);
+    b = _mm512_shuffle_epi8(_mm512_loadu_si512((void *) (src + i + 64)), split);
+    lo = _mm512_unpacklo_epi64(a, b);
+    hi = _mm512_unpackhi_epi64(a, b);
+    n = _mm512_and_si512(lo, mask);
+    rlo = _mm512_shuffle_epi8(t[0], n);
+    rhi = _mm512_shuffle_epi8(t[4], n);
+    n = _mm512_and_si512(_mm512_srli_epi64(lo, 4), mask);
+    rlo = _mm512_xor_si512(rlo, _mm512_shuffle_epi8(t[1], n));
+    rhi = _mm512_xor_si512(rhi, _mm512_shuffle_epi8(t[5], n));
+    n = _mm512_and_si512(hi, mask);
+    rlo = _mm512_xor_si512(rlo, _mm512_shuffle_epi8(t[2], n));
+    rhi = _mm512_xor_si512(rhi, _mm512_shuffle_epi8(t[6], n));
+    n = _mm512_and_si512(_mm512_srli_epi64(hi, 4), mask);
+    rlo = _mm512_xor_si512(rlo, _mm512_shuffle_epi8(t[3], n));
+    rhi = _mm512_xor_si512(rhi, _mm512_shuffle_epi8(t[7], n));
+    a = _mm512_unpacklo_epi8(rlo, rhi);
+    b = _mm512_unpackhi_epi8(rlo, rhi);
+    if (add) {
+      a = _mm512_xor_si512(a, _mm512_loadu_si512((void *) (dst + i)));
+      b = _mm512_xor_si512(b, _mm512_loadu_si512((void *) (dst + i + 64)));
+    }
+    _mm512_storeu_si512((void *) (dst + i), a);
+    _mm512_storeu_si512((void *) (dst + i + 64), b);
+  }
+}
+
+/* Multiplies the largest prefix of the region that the best kernel of the
+   processor can handle, and returns its size in bytes (0 if none). */
+
+static int galois_w16_region_simd(unsigned char *src, unsigned char *dst, int nbytes,
+                                  int multby, int add)
+{
+  unsigned char tlo[64], thi[64];
+  int done;
+
+  if (galois_simd < 0) galois_simd_init();
+  if (galois_simd == 0) return 0;
+  done = nbytes & ~((16 << galois_simd) - 1);
+  if (done == 0) return 0;
+  galois_w16_nibble_tables(multby, tlo, thi);
+  switch (galois_simd) {
+    case 3: galois_w16_region_avx512(src, dst, done, tlo, thi, add); break;
+    case 2: galois_w16_region_avx2(src, dst, done, tlo, thi, add); break;
+    default: galois_w16_region_ssse3(src, dst, done, tlo, thi, add); break;
+  }
+  return done;
+}
+
+/* Xor of two regions, used by the bitmatrix schedules.  SSE2 is always
+   there on x86-64, AVX2 is used when the processor has it.  Returns the
+   size in bytes of the prefix done. */
+
+__attribute__((target("avx2")))
+static void galois_region_xor_avx2(char *r1, char *r2, char *r3, int nbytes)
+{
+  __m256i x, y;
+  int i;
+
+  for (i = 0; i < nbytes; i += 64) {
+    x = _mm256_xor_si256(_mm256_loadu_si256((__m256i *) (r1 + i)),
+                         _mm256_loadu_si256((__m256i *) (r2 + i)));
+    y = _mm256_xor_si256(_mm256_loadu_si256((__m256i *) (r1 + i + 32)),
+                         _mm256_loadu_si256((__m256i *) (r2 + i + 32)));
+    _mm256_storeu_si256((__m256i *) (r3 + i), x);
+    _mm256_storeu_si256((__m256i *) (r3 + i + 32), y);
+  }
+}
+
+static int galois_region_xor_simd(char *r1, char *r2, char *r3, int nbytes)
+{
+  __m128i x;
+  int done, i;
+
+  if (galois_simd < 0) galois_simd_init();
+  done = nbytes & ~63;
+  if (galois_simd >= 2) {
+    galois_region_xor_avx2(r1, r2, r3, done);
+    return done;
+  }
+  done = nbytes & ~15;
+  for (i = 0; i < done; i += 16) {
+    x = _mm_xor_si128(_mm_loadu_si128((__m128i *) (r1 + i)),
+                      _mm_loadu_si128((__m128i *) (r2 + i)));
+    _mm_storeu_si128((__m128i *) (r3 + i), x);
+  }
+  return done;
+}
+#endif
+
 void galois_w08_region_multiply(char *region,      /* Region to multiply */
                                   int multby,       /* Number to multiply by */
                                   int nbytes,        /* Number of bytes in region */
@@ -445,8 +760,12 @@ void galois_w08_region_multiply(char *region,      /* Region to multiply */
     }
   }
   srow = multby * nw[8];
+  i = 0;
+#ifdef GALOIS_SIMD
+  i = galois_w08_region_simd(ur1, ur2, nbytes, multby, (r2 != NULL && add));
+#endif
   if (r2 == NULL || !add) {
-    for (i = 0; i < nbytes; i++) {
+    for (; i < nbytes; i++) {
       prod = galois_mult_tables[8][srow+ur1[i]];
       ur2[i] = prod;
     }
@@ -454,7 +773,7 @@ void galois_w08_region_multiply(char *region,      /* Region to multiply */
     sol = sizeof(long);
     lp2 = &l;
     lp = (unsigned char *) lp2;
-    for (i = 0; i < nbytes; i += sol) {
+    for (; i < nbytes; i += sol) {
       cp = ur2+i;
       lp2 = (unsigned long *) cp;
       for (j = 0; j < sol; j++) {
@@ -514,9 +833,14 @@ void galois_w16_region_multiply(char *region,      /* Region to multiply */
     }
   }
   log1 = galois_log_tables[16][multby];
+  i = 0;
+#ifdef GALOIS_SIMD
+  i = galois_w16_region_simd((unsigned char *) ur1, (unsigned char *) ur2, nbytes*2,
+                             multby, (r2 != NULL && add)) / 2;
+#endif
 
   if (r2 == NULL || !add) {
-    for (i = 0; i < nbytes; i++) {
+    for (; i < nbytes; i++) {
       if (ur1[i] == 0) {
         ur2[i] = 0;
       } else {
@@ -528,7 +852,7 @@ void galois_w16_region_multiply(char *region,      /* Region to multiply */
     sol = sizeof(long)/2;
     lp2 = &l;
     lp = (unsigned short *) lp2;
-    for (i = 0; i < nbytes; i += sol) {
+    for (; i < nbytes; i += sol) {
       cp = ur2+i;
       lp2 = (unsigned long *) cp;
       for (j = 0; j < sol; j++) {
@@ -738,12 +1062,16 @@ void galois_region_xor(           char *r1,         /* Region 1 */
   long *l3;
   long *ltop;
   char *ctop;
+  int done = 0;
 
+#ifdef GALOIS_SIMD
+  done = galois_region_xor_simd(r1, r2, r3, nbytes);
+#endif
   ctop = r1 + nbytes;
   ltop = (long *) ctop;
-  l1 = (long *) r1;
-  l2 = (long *) r2;
-  l3 = (long *) r3;
+  l1 = (long *) (r1 + done);
+  l2 = (long *) (r2 + done);
+  l3 = (long *) (r3 + done);
 
   while (l1 < ltop) {
     *l3 = ((*l1)  ^ (*l2));
@@ -0,0 +1,652 @@
+/**
+ *  @file   incr.c
+ *  @author Leonardo A. Bautista Gomez (leobago@gmail.com)
+ *  @date   October, 2026
+ *  @brief  Incremental checkpointing functions for the FTI library.
+ */
+
+
+#include "fti.h"
+#include <stdint.h>
+
+
+/** Primes of the 64-bit block hash.                                       */
+#define FTI_HP1     11400714785074694791ULL
+#define FTI_HP2     14029467366897019727ULL
+#define FTI_HP3     1609587929392839161ULL
+#define FTI_HP4     9650029242287828579ULL
+#define FTI_HP5     2870177450012600261ULL
+
+/** Magic number at the beginning of the delta files.                      */
+static const char          FTI_IncMagic[8] = {'F','T','I','D','E','L','T','A'};
+
+/** Block hashes of the last committed checkpoint.                         */
+static uint64_t            *FTI_IncHashes = NULL;
+
+/** Block hashes of the checkpoint being written.                          */
+static uint64_t            *FTI_IncNew = NULL;
+
+/** Map of the blocks changed since the last committed checkpoint.         */
+static unsigned char       *FTI_IncMap = NULL;
+
+/** Number of blocks of all the protected datasets.                        */
+static unsigned long       FTI_IncNbBlocks = 0;
+
+/** Layout (IDs and sizes) of the datasets the hashes belong to.           */
+static int                 FTI_IncNbVar = -1;
+static int                 FTI_IncIds[FTI_BUFS];
+static long                FTI_IncSizes[FTI_BUFS];
+
+/** Committed chain of L1 checkpoint IDs, base first. Empty if no chain.   */
+static char                FTI_IncChain[FTI_BUFS] = "";
+
+/** Chain that becomes committed if the current checkpoint succeeds.       */
+static char                FTI_IncPend[FTI_BUFS] = "";
+
+
+/** Rotation, round and merge steps of the block hash.                     */
+static inline uint64_t FTI_IncRotl(uint64_t x, int r) {
+    return (x << r) | (x >> (64 - r));
+}
+
+static inline uint64_t FTI_IncRound(uint64_t acc, uint64_t in) {
+    acc = acc + in * FTI_HP2;
+    acc = FTI_IncRotl(acc, 31);
+    return acc * FTI_HP1;
+}
+
+static inline uint64_t FTI_IncMerge(uint64_t acc, uint64_t val) {
+    acc = acc ^ FTI_IncRound(0, val);
+    return acc * FTI_HP1 + FTI_HP4;
+}
+
+
+/*-------------------------------------------------------------------------*/
+/**
+    @brief      It hashes a memory region.
+    @param      buf             Pointer to the region.
+    @param      len             Size of the region.
+    @return     uint64_t        The 64-bit hash of the region.
+
+    This function computes a 64-bit hash of a block of data, processing
+    four 64-bit lanes in parallel (same structure as xxHash64).
+
+ **/
+/*-------------------------------------------------------------------------*/
+uint64_t FTI_IncHash(const unsigned char *buf, unsigned long len) {
+    const unsigned char *end = buf + len;
+    uint64_t h, w, v1, v2, v3, v4;
+    uint32_t k;
+    if (len >= 32)
+    {
+        v1 = FTI_HP1 + FTI_HP2;
+        v2 = FTI_HP2;
+        v3 = 0;
+        v4 = 0 - FTI_HP1;
+        while (buf + 32 <= end)
+        {
+            memcpy(&w, buf, 8);    v1 = FTI_IncRound(v1, w);
+            memcpy(&w, buf+8, 8);  v2 = FTI_IncRound(v2, w);
+            memcpy(&w, buf+16, 8); v3 = FTI_IncRound(v3, w);
+            memcpy(&w, buf+24, 8); v4 = FTI_IncRound(v4, w);
+            buf = buf + 32;
+        }
+        h = FTI_IncRotl(v1, 1) + FTI_IncRotl(v2, 7) + FTI_IncRotl(v3, 12) + FTI_IncRotl(v4, 18);
+        h = FTI_IncMerge(h, v1);
+        h = FTI_IncMerge(h, v2);
+        h = FTI_IncMerge(h, v3);
+        h = FTI_IncMerge(h, v4);
+    } else {
+        h = FTI_HP5;
+    }
+    h = h + (uint64_t) len;
+    while (buf + 8 <= end)
+    {
+        memcpy(&w, buf, 8);
+        h = h ^ FTI_IncRound(0, w);
+        h = FTI_IncRotl(h, 27) * FTI_HP1 + FTI_HP4;
+        buf = buf + 8;
+    }
+    if (buf + 4 <= end)
+    {
+        memcpy(&k, buf, 4);
+        h = h ^ ((uint64_t) k * FTI_HP1);
+        h = FTI_IncRotl(h, 23) * FTI_HP2 + FTI_HP3;
+        buf = buf + 4;
+    }
+    while (buf < end)
+    {
+        h = h ^ ((*buf) * FTI_HP5);
+        h = FTI_IncRotl(h, 11) * FTI_HP1;
+        buf++;
+    }
+    h = h ^ (h >> 33);
+    h = h * FTI_HP2;
+    h = h ^ (h >> 29);
+    h = h * FTI_HP3;
+    h = h ^ (h >> 32);
+    return h;
+}
+
+
+/*-------------------------------------------------------------------------*/
+/**
+    @brief      It builds the name of a checkpoint file of the chain.
+    @param      fn              Buffer to fill with the file name.
+    @param      dir             Directory of the file.
+    @param      id              Checkpoint ID of the file.
+    @return     void
+
+    This function builds the name of the file of checkpoint ID id for the
+    rank that owns the current checkpoint file.
+
+ **/
+/*-------------------------------------------------------------------------*/
+void FTI_IncFile(char *fn, char *dir, int id) {
+    int ckptID, rank;
+    sscanf(FTI_Exec.ckptFile, "Ckpt%d-Rank%d.fti", &ckptID, &rank);
+    sprintf(fn, "%s/Ckpt%d-Rank%d.fti", dir, id, rank);
+}
+
+
+/*-------------------------------------------------------------------------*/
+/**
+    @brief      It reads the header of a delta file.
+    @param      fd              Delta file, at offset 0.
+    @param      bs              Pointer to fill with the block size.
+    @param      nbVar           Pointer to fill with the number of datasets.
+    @param      sizes           Array to fill with the dataset sizes.
+    @param      map             Pointer to fill with the block map.
+    @return     integer         FTI_SCES if successful.
+
+    This function reads and checks the header of a delta file. The block
+    map is allocated here and has to be freed by the caller.
+
+ **/
+/*-------------------------------------------------------------------------*/
+int FTI_IncHeader(FILE *fd, unsigned long *bs, unsigned long *nbVar, unsigned long *sizes, unsigned char **map) {
+    char magic[8];
+    unsigned long hdr[2], nb = 0, i;
+    if (fread(magic, 1, 8, fd) != 8 || memcmp(magic, FTI_IncMagic, 8) != 0)
+    {
+        FTI_Print("Delta file header is not valid.", FTI_WARN);
+        return FTI_NSCS;
+    }
+    if (fread(hdr, sizeof(unsigned long), 2, fd) != 2 || hdr[0] == 0 || hdr[1] > FTI_BUFS)
+    {
+        FTI_Print("Delta file header is not valid.", FTI_WARN);
+        return FTI_NSCS;
+    }
+    *bs = hdr[0];
+    *nbVar = hdr[1];
+    if (fread(sizes, sizeof(unsigned long), *nbVar, fd) != *nbVar)
+    {
+        FTI_Print("Delta file dataset sizes could not be read.", FTI_WARN);
+        return FTI_NSCS;
+    }
+    for (i = 0; i < *nbVar; i++)
+    {
+        nb = nb + (sizes[i] + *bs - 1) / *bs;
+    }
+    *map = talloc(unsigned char, (nb+7)/8 + 1);
+    if (fread(*map, 1, (nb+7)/8, fd) != (nb+7)/8)
+    {
+        FTI_Print("Delta file block map could not be read.", FTI_WARN);
+        free(*map);
+        return FTI_NSCS;
+    }
+    return FTI_SCES;
+}
+
+
+/*-------------------------------------------------------------------------*/
+/**
+    @brief      It hashes the datasets and decides the kind of checkpoint.
+    @param      FTI_Data        Dataset array.
+    @return     integer         FTI_SCES if a delta can be written.
+
+    This function hashes every block of the protected datasets and marks
+    the blocks that changed since the last committed checkpoint. Blocks of
+    tracked datasets lying in protected pages are not hashed, the pages
+    written since the last checkpoint tell whether they changed. A delta
+    can only be written for a L1 checkpoint, if the datasets have the same
+    layout as in the last checkpoint and if the chain did not reach the
+    maximum number of deltas. The immutable files of the chain are then
+    linked in the local temporary directory, so that they follow the new
+    checkpoint when it is renamed. FTI_NSCS means a full checkpoint.
+
+ **/
+/*-------------------------------------------------------------------------*/
+int FTI_IncPrepare(FTIT_dataset* FTI_Data) {
+    unsigned long bs = FTI_Conf.incBlockSize, nb = 0, b = 0, len;
+    long off;
+    char *tok, *save, chain[FTI_BUFS], src[FTI_BUFS], dst[FTI_BUFS];
+    int i, dirty, deltas = 0, same = (FTI_Exec.nbVar == FTI_IncNbVar);
+    FTI_Exec.incChain[0] = '\0';
+    FTI_IncPend[0] = '\0';
+    if (FTI_Exec.ckptLvel != 1)
+    { // Other levels clean the L1 directory, the chain is lost
+        FTI_IncChain[0] = '\0';
+        return FTI_NSCS;
+    }
+    for (i = 0; i < FTI_Exec.nbVar; i++)
+    {
+        nb = nb + (FTI_Data[i].size + bs - 1) / bs;
+        if (same && (FTI_Data[i].id != FTI_IncIds[i] || FTI_Data[i].size != FTI_IncSizes[i])) same = 0;
+    }
+    if (!same)
+    { // New layout, the previous hashes are useless
+        FTI_IncChain[0] = '\0';
+        FTI_IncNbVar = FTI_Exec.nbVar;
+        for (i = 0; i < FTI_Exec.nbVar; i++)
+        {
+            FTI_IncIds[i] = FTI_Data[i].id;
+            FTI_IncSizes[i] = FTI_Data[i].size;
+        }
+        free(FTI_IncHashes);
+        free(FTI_IncNew);
+        free(FTI_IncMap);
+        FTI_IncHashes = talloc(uint64_t, nb + 1);
+        FTI_IncNew = talloc(uint64_t, nb + 1);
+        FTI_IncMap = talloc(unsigned char, (nb+7)/8 + 1);
+        FTI_IncNbBlocks = nb;
+    }
+    memset(FTI_IncMap, 0, (FTI_IncNbBlocks+7)/8 + 1);
+    for (i = 0; i < FTI_Exec.nbVar; i++)
+    {
+        for (off = 0; off < FTI_Data[i].size; off = off + bs)
+        {
+            len = ((FTI_Data[i].size - off) < bs) ? FTI_Data[i].size - off : bs;
+            dirty = (FTI_Data[i].tracked) ? FTI_TrackBlock(i, off, len) : -1;
+            if (dirty < 0)
+            { // Not known from the page protection, hash the block
+                FTI_IncNew[b] = FTI_IncHash((unsigned char *) FTI_Data[i].ptr + off, len);
+                dirty = (FTI_IncChain[0] == '\0' || FTI_IncNew[b] != FTI_IncHashes[b]);
+            }
+            if (FTI_IncChain[0] == '\0' || dirty)
+            {
+                FTI_IncMap[b/8] = FTI_IncMap[b/8] | (1 << (b%8));
+            }
+            b++;
+        }
+    }
+    for (i = 0; FTI_IncChain[i] != '\0'; i++)
+    {
+        if (FTI_IncChain[i] == ' ') deltas++;
+    }
+    snprintf(FTI_IncPend, FTI_BUFS, "%d", FTI_Exec.ckptID);
+    if (FTI_IncChain[0] == '\0' || deltas >= FTI_Conf.incMaxDeltas)
+    {
+        return FTI_NSCS;
+    }
+    snprintf(chain, FTI_BUFS, "%s", FTI_IncChain);
+    for (tok = strtok_r(chain, " ", &save); tok != NULL; tok = strtok_r(NULL, " ", &save))
+    { // Link the files of the chain next to the new delta
+        FTI_IncFile(src, FTI_Ckpt[1].dir, atoi(tok));
+        FTI_IncFile(dst, FTI_Conf.lTmpDir, atoi(tok));
+        remove(dst);
+        if (link(src, dst) != 0)
+        {
+            FTI_Print("Ckpt. chain could not be linked, writing a full ckpt.", FTI_WARN);
+            return FTI_NSCS;
+        }
+    }
+    snprintf(FTI_Exec.incChain, FTI_BUFS, "%s", FTI_IncChain);
+    snprintf(FTI_IncPend, FTI_BUFS, "%s %d", FTI_IncChain, FTI_Exec.ckptID);
+    return FTI_SCES;
+}
+
+
+/*-------------------------------------------------------------------------*/
+/**
+    @brief      It writes the blocks changed since the last checkpoint.
+    @param      fn              Name of the delta file.
+    @param      FTI_Data        Dataset array.
+    @return     integer         FTI_SCES if successful.
+
+    This function writes a delta file: a header with the block size, the
+    dataset sizes and the map of changed blocks, followed by the changed
+    blocks in dataset order. FTI_IncPrepare must be called before.
+
+ **/
+/*-------------------------------------------------------------------------*/
+int FTI_WriteDelta(char *fn, FTIT_dataset* FTI_Data) {
+    unsigned long hdr[2], sizes[FTI_BUFS], bs = FTI_Conf.incBlockSize, b = 0, len, dirty = 0;
+    char str[FTI_BUFS];
+    long off;
+    FILE *fd;
+    int i;
+    fd = fopen(fn, "wb");
+    if (fd == NULL)
+    {
+        FTI_Print("FTI delta file could not be opened.", FTI_EROR);
+        return FTI_NSCS;
+    }
+    hdr[0] = bs;
+    hdr[1] = FTI_Exec.nbVar;
+    for (i = 0; i < FTI_Exec.nbVar; i++)
+    {
+        sizes[i] = FTI_Data[i].size;
+    }
+    if (fwrite(FTI_IncMagic, 1, 8, fd) != 8 || fwrite(hdr, sizeof(unsigned long), 2, fd) != 2 ||
+        fwrite(sizes, sizeof(unsigned long), hdr[1], fd) != hdr[1] ||
+        fwrite(FTI_IncMap, 1, (FTI_IncNbBlocks+7)/8, fd) != (FTI_IncNbBlocks+7)/8)
+    {
+        FTI_Print("FTI delta file header could not be written.", FTI_EROR);
+        fclose(fd);
+        return FTI_NSCS;
+    }
+    for (i = 0; i < FTI_Exec.nbVar; i++)
+    {
+        for (off = 0; off < FTI_Data[i].size; off = off + bs)
+        {
+            if (FTI_IncMap[b/8] & (1 << (b%8)))
+            {
+                len = ((FTI_Data[i].size - off) < bs) ? FTI_Data[i].size - off : bs;
+                if (fwrite((char *) FTI_Data[i].ptr + off, 1, len, fd) != len)
+                {
+                    sprintf(str, "Dataset #%d could not be written.", FTI_Data[i].id);
+                    FTI_Print(str, FTI_EROR);
+                    fclose(fd);
+                    return FTI_NSCS;
+                }
+                dirty++;
+            }
+            b++;
+        }
+    }
+    if (fclose(fd) != 0)
+    {
+        FTI_Print("FTI delta file could not be flushed.", FTI_EROR);
+        return FTI_NSCS;
+    }
+    sprintf(str, "Delta file with %lu of %lu blocks.", dirty, FTI_IncNbBlocks);
+    FTI_Print(str, FTI_DBUG);
+    return FTI_SCES;
+}
+
+
+/*-------------------------------------------------------------------------*/
+/**
+    @brief      It commits or discards the hashes of the last checkpoint.
+    @param      res             Result of the checkpoint post-processing.
+    @return     integer         FTI_SCES if successful.
+
+    This function is called once the checkpoint has been post-processed.
+    If a L1 checkpoint succeeded, its hashes become the reference for the
+    next delta and it is appended to the chain. Otherwise, the chain is
+    dropped and the next checkpoint will be a full one.
+
+ **/
+/*-------------------------------------------------------------------------*/
+int FTI_IncCommit(int res) {
+    uint64_t *tmp;
+    if (res == FTI_SCES && FTI_Exec.ckptLvel == 1 && FTI_IncPend[0] != '\0')
+    {
+        tmp = FTI_IncHashes;
+        FTI_IncHashes = FTI_IncNew;
+        FTI_IncNew = tmp;
+        snprintf(FTI_IncChain, FTI_BUFS, "%s", FTI_IncPend);
+    } else {
+        FTI_IncChain[0] = '\0';
+    }
+    FTI_IncPend[0] = '\0';
+    return FTI_SCES;
+}
+
+
+/*-------------------------------------------------------------------------*/
+/**
+    @brief      It drops the incremental chain.
+    @return     integer         FTI_SCES if successful.
+
+    This function makes the next checkpoint a full one, for instance when
+    the hashes of some blocks cannot be trusted anymore.
+
+ **/
+/*-------------------------------------------------------------------------*/
+int FTI_IncReset() {
+    FTI_IncChain[0] = '\0';
+    return FTI_SCES;
+}
+
+
+/*-------------------------------------------------------------------------*/
+/**
+    @brief      It checks that all the files of the chain are there.
+    @param      dir             Directory of the checkpoint files.
+    @return     integer         0 if all files exist, 1 if not.
+
+    This function checks that the base and previous delta files of the
+    current checkpoint (FTI_Exec.incChain) can be read.
+
+ **/
+/*-------------------------------------------------------------------------*/
+int FTI_IncCheck(char *dir) {
+    char *tok, *save, chain[FTI_BUFS], fn[FTI_BUFS];
+    snprintf(chain, FTI_BUFS, "%s", FTI_Exec.incChain);
+    for (tok = strtok_r(chain, " ", &save); tok != NULL; tok = strtok_r(NULL, " ", &save))
+    {
+        FTI_IncFile(fn, dir, atoi(tok));
+        if (access(fn, R_OK) != 0) return 1;
+    }
+    return 0;
+}
+
+
+/*-------------------------------------------------------------------------*/
+/**
+    @brief      It applies a delta file to the protected datasets.
+    @param      fn              Name of the delta file.
+    @param      FTI_Data        Dataset array.
+    @param      id              ID of the dataset to update, -1 for all.
+    @return     integer         FTI_SCES if successful.
+
+    This function reads the blocks stored in a delta file directly in the
+    protected datasets, which must have the layout recorded in the header.
+    When an ID is given, the blocks of the other datasets are skipped.
+
+ **/
+/*-------------------------------------------------------------------------*/
+int FTI_IncApply(char *fn, FTIT_dataset* FTI_Data, int id) {
+    unsigned long bs, nbVar, sizes[FTI_BUFS], b = 0, len;
+    unsigned char *map;
+    long off;
+    FILE *fd;
+    int i, res = FTI_SCES;
+    fd = fopen(fn, "rb");
+    if (fd == NULL)
+    {
+        FTI_Print("Could not open FTI delta file.", FTI_EROR);
+        return FTI_NSCS;
+    }
+    if (FTI_IncHeader(fd, &bs, &nbVar, sizes, &map) != FTI_SCES)
+    {
+        fclose(fd);
+        return FTI_NSCS;
+    }
+    if (nbVar != FTI_Exec.nbVar)
+    {
+        FTI_Print("Delta file does not match the protected datasets.", FTI_WARN);
+        res = FTI_NSCS;
+    }
+    for (i = 0; i < FTI_Exec.nbVar && res == FTI_SCES; i++)
+    {
+        if (sizes[i] != FTI_Data[i].size)
+        {
+            FTI_Print("Delta file does not match the protected datasets.", FTI_WARN);
+            res = FTI_NSCS;
+            break;
+        }
+        for (off = 0; off < FTI_Data[i].size; off = off + bs)
+        {
+            if (map[b/8] & (1 << (b%8)))
+            {
+                len = ((FTI_Data[i].size - off) < bs) ? FTI_Data[i].size - off : bs;
+                if ((id < 0 || FTI_Data[i].id == id) ?
+                    fread((char *) FTI_Data[i].ptr + off, 1, len, fd) != len :
+                    fseek(fd, len, SEEK_CUR) != 0)
+                {
+                    FTI_Print("Delta file is truncated.", FTI_WARN);
+                    res = FTI_NSCS;
+                    break;
+                }
+            }
+            b++;
+        }
+    }
+    free(map);
+    fclose(fd);
+    return res;
+}
+
+
+/*-------------------------------------------------------------------------*/
+/**
+    @brief      It recovers the datasets from an incremental chain.
+    @param      FTI_Data        Dataset array.
+    @param      id              ID of the dataset to recover, -1 for all.
+    @return     integer         FTI_SCES if successful.
+
+    This function reads the base checkpoint of the chain and then applies
+    all the deltas in order, the last one being the current checkpoint.
+
+ **/
+/*-------------------------------------------------------------------------*/
+int FTI_IncRecover(FTIT_dataset* FTI_Data, int id) {
+    char *tok, *save, chain[FTI_BUFS], fn[FTI_BUFS], str[FTI_BUFS];
+    snprintf(chain, FTI_BUFS, "%s", FTI_Exec.incChain);
+    tok = strtok_r(chain, " ", &save);
+    FTI_IncFile(fn, FTI_Ckpt[FTI_Exec.ckptLvel].dir, atoi(tok));
+    sprintf(str, "Loading base of the ckpt. chain (%s)...", fn);
+    FTI_Print(str, FTI_DBUG);
+    if (FTI_ReadCkpt(fn, FTI_Data, id) != FTI_SCES) return FTI_NSCS;
+    for (tok = strtok_r(NULL, " ", &save); tok != NULL; tok = strtok_r(NULL, " ", &save))
+    {
+        FTI_IncFile(fn, FTI_Ckpt[FTI_Exec.ckptLvel].dir, atoi(tok));
+        if (FTI_IncApply(fn, FTI_Data, id) != FTI_SCES) return FTI_NSCS;
+    }
+    sprintf(fn, "%s/%s", FTI_Ckpt[FTI_Exec.ckptLvel].dir, FTI_Exec.ckptFile);
+    return FTI_IncApply(fn, FTI_Data, id);
+}
+
+
+/*-------------------------------------------------------------------------*/
+/**
+    @brief      It rebuilds a full checkpoint file from its chain.
+    @param      lfn             Local checkpoint (last delta) file name.
+    @param      gfn             Full checkpoint file to create.
+    @return     integer         FTI_SCES if successful.
+
+    This function copies the base file of the chain and writes over it the
+    blocks of every delta, in order, so that the result is the same file
+    a full checkpoint would have produced. The blocks of each dataset are
+    placed at its offset in the table of contents of the base file, whose
+    header is then rewritten without the checksums of the datasets.
+
+ **/
+/*-------------------------------------------------------------------------*/
+int FTI_IncFlatten(char *lfn, char *gfn) {
+    char *tok, *save, *buf, chain[FTI_BUFS], dir[FTI_BUFS], fn[FTI_BUFS];
+    unsigned long bs, nbVar, sizes[FTI_BUFS], b, len, size, pos, hsize = 0;
+    FTIT_tocentry toc[FTI_BUFS];
+    FTIT_tocheader hdr;
+    unsigned char *map;
+    FILE *fd, *gfd;
+    int i, k, res = FTI_SCES, last = 0;
+    snprintf(dir, FTI_BUFS, "%s", lfn);
+    if (strrchr(dir, '/') != NULL) *strrchr(dir, '/') = '\0';
+    snprintf(chain, FTI_BUFS, "%s", FTI_Exec.incChain);
+    tok = strtok_r(chain, " ", &save);
+    FTI_IncFile(fn, dir, atoi(tok));
+    fd = fopen(fn, "rb");
+    gfd = fopen(gfn, "wb");
+    if (fd == NULL || gfd == NULL)
+    {
+        FTI_Print("L4 cannot open the files of the ckpt. chain.", FTI_EROR);
+        if (fd != NULL) fclose(fd);
+        if (gfd != NULL) fclose(gfd);
+        return FTI_NSCS;
+    }
+    k = FTI_TocRead(fd, &hdr, toc);
+    if (k < 0 || fseek(fd, 0, SEEK_SET) != 0)
+    {
+        FTI_Print("L4 cannot read the base of the ckpt. chain.", FTI_EROR);
+        fclose(fd);
+        fclose(gfd);
+        return FTI_NSCS;
+    }
+    if (k == 1) hsize = hdr.dataOff;
+    buf = talloc(char, FTI_Conf.blockSize);
+    while ((len = fread(buf, 1, FTI_Conf.blockSize, fd)) > 0)
+    { // Copy of the base file
+        if (fwrite(buf, 1, len, gfd) != len) break;
+    }
+    if (ferror(fd) || ferror(gfd))
+    {
+        FTI_Print("L4 failed to copy the base of the ckpt. chain.", FTI_EROR);
+        res = FTI_NSCS;
+    }
+    fclose(fd);
+    free(buf);
+    while (!last && res == FTI_SCES)
+    { // Apply the deltas, the current file being the last one
+        tok = strtok_r(NULL, " ", &save);
+        if (tok != NULL)
+        {
+            FTI_IncFile(fn, dir, atoi(tok));
+        } else {
+            snprintf(fn, FTI_BUFS, "%s", lfn);
+            last = 1;
+        }
+        fd = fopen(fn, "rb");
+        if (fd == NULL || FTI_IncHeader(fd, &bs, &nbVar, sizes, &map) != FTI_SCES)
+        {
+            FTI_Print("L4 cannot read a delta file of the ckpt. chain.", FTI_EROR);
+            if (fd != NULL) fclose(fd);
+            res = FTI_NSCS;
+            break;
+        }
+        buf = talloc(char, bs);
+        b = 0;
+        size = hsize;
+        for (i = 0; i < nbVar && res == FTI_SCES; i++)
+        {
+            if (hsize > 0 && i < hdr.nbVar) size = toc[i].offset;
+            for (pos = 0; pos < sizes[i]; pos = pos + bs)
+            {
+                if (map[b/8] & (1 << (b%8)))
+                {
+                    len = ((sizes[i] - pos) < bs) ? sizes[i] - pos : bs;
+                    if (fread(buf, 1, len, fd) != len || fseek(gfd, size + pos, SEEK_SET) != 0 ||
+                        fwrite(buf, 1, len, gfd) != len)
+                    {
+                        FTI_Print("L4 failed to apply a delta file.", FTI_EROR);
+                        res = FTI_NSCS;
+                        break;
+                    }
+                }
+                b++;
+            }
+            size = size + sizes[i];
+        }
+        free(buf);
+        free(map);
+        fclose(fd);
+    }
+    if (res == FTI_SCES && hsize > 0)
+    { // The datasets changed, their checksums do not hold anymore
+        hdr.flags &= ~FTI_TOC_CRC;
+        hdr.crc = 0;
+        for (i = 0; i < hdr.nbVar; i++) toc[i].crc = 0;
+        buf = calloc(1, hsize);
+        memcpy(buf, &hdr, sizeof(FTIT_tocheader));
+        memcpy(buf + sizeof(FTIT_tocheader), toc, hdr.nbVar*sizeof(FTIT_tocentry));
+        ((FTIT_tocheader *) buf)->crc = FTI_Crc32c(0, buf, hsize);
+        if (fseek(gfd, 0, SEEK_SET) != 0 || fwrite(buf, 1, hsize, gfd) != hsize) res = FTI_NSCS;
+        free(buf);
+        if (res != FTI_SCES) FTI_Print("L4 failed to rewrite the ckpt. header.", FTI_EROR);
+    }
+    if (fclose(gfd) != 0) res = FTI_NSCS;
+    return res;
+}
@@ -0,0 +1,567 @@
+/**
+ *  @file   io.c
+ *  @author Leonardo A. Bautista Gomez (leobago@gmail.com)
+ *  @date   October, 2026
+ *  @brief  Checkpoint I/O functions for the FTI library.
+ */
+
+
+#define _GNU_SOURCE
+
+#include "fti.h"
+#include <fcntl.h>
+#include <limits.h>
+#include <sys/uio.h>
+#include <sys/mman.h>
+
+#ifndef IOV_MAX
+#define IOV_MAX 1024
+#endif
+#ifndef O_DIRECT
+#define O_DIRECT 0
+#endif
+
+
+/*-------------------------------------------------------------------------*/
+/**
+    @brief      It writes an I/O vector at the given file offset.
+    @param      fd              File descriptor of the target file.
+    @param      iov             I/O vector to write (modified).
+    @param      cnt             Number of elements in the I/O vector.
+    @param      offset          File offset where to start writing.
+    @return     integer         FTI_SCES if successful.
+
+    This function writes the whole I/O vector with as few pwritev calls as
+    possible. The vector is split in chunks of IOV_MAX elements and partial
+    writes are resumed from the first byte not yet written. The I/O vector
+    is consumed in the process, so the caller should not reuse it.
+
+ **/
+/*-------------------------------------------------------------------------*/
+int FTI_PwriteVect(int fd, struct iovec *iov, int cnt, off_t offset) {
+    ssize_t written;
+    int i = 0, n;
+    while (i < cnt)
+    {
+        if (iov[i].iov_len == 0)
+        { // Skip empty datasets
+            i++;
+            continue;
+        }
+        n = ((cnt - i) > IOV_MAX) ? IOV_MAX : cnt - i;
+        written = pwritev(fd, iov + i, n, offset);
+        if (written < 0 && errno == EINTR) continue;
+        if (written <= 0)
+        { // Nothing written with bytes left, as on a full device
+            FTI_Print("Vectored write of the checkpoint failed.", FTI_EROR);
+            return FTI_NSCS;
+        }
+        offset = offset + written;
+        while (i < cnt && (size_t) written >= iov[i].iov_len)
+        { // Skip the elements completely written
+            written = written - iov[i].iov_len;
+            i++;
+        }
+        if (written > 0)
+        { // Resume partially written element
+            iov[i].iov_base = (char *) iov[i].iov_base + written;
+            iov[i].iov_len = iov[i].iov_len - written;
+        }
+    }
+    return FTI_SCES;
+}
+
+
+/*-------------------------------------------------------------------------*/
+/**
+    @brief      It writes the checkpoint data with vectored I/O.
+    @param      fn              Name of the checkpoint file.
+    @param      FTI_Data        Dataset array.
+    @return     integer         FTI_SCES if successful.
+
+    This function builds an I/O vector with the file header and all the
+    protected datasets and writes it with pwritev, bypassing the stdio
+    buffering. The checkpoint file is preallocated to its final size before
+    writing, so that the file system can allocate the blocks in one shot.
+
+ **/
+/*-------------------------------------------------------------------------*/
+int FTI_WriteVect(char *fn, FTIT_dataset* FTI_Data) {
+    unsigned long hsize;
+    struct iovec *iov;
+    char str[FTI_BUFS], *hdr;
+    int i, fd, res;
+    hdr = FTI_TocBuild(FTI_Data, &hsize);
+    if (hdr == NULL) return FTI_NSCS;
+    iov = talloc(struct iovec, FTI_Exec.nbVar + 1);
+    iov[0].iov_base = hdr;
+    iov[0].iov_len = hsize;
+    for (i = 0; i < FTI_Exec.nbVar; i++)
+    {
+        iov[i+1].iov_base = FTI_Data[i].ptr;
+        iov[i+1].iov_len = FTI_Data[i].size;
+    }
+    fd = open(fn, O_WRONLY | O_CREAT | O_TRUNC, 0666);
+    if (fd == -1)
+    {
+        FTI_Print("FTI checkpoint file could not be opened.", FTI_EROR);
+        free(iov);
+        free(hdr);
+        return FTI_NSCS;
+    }
+    if (FTI_Exec.ckptSize > 0)
+    {
+        res = posix_fallocate(fd, 0, hsize + FTI_Exec.ckptSize);
+        if (res != 0)
+        { // Not all file systems support preallocation
+            sprintf(str, "Checkpoint file could not be preallocated (%s).", strerror(res));
+            FTI_Print(str, FTI_DBUG);
+        }
+    }
+    res = FTI_PwriteVect(fd, iov, FTI_Exec.nbVar + 1, 0);
+    free(iov);
+    free(hdr);
+    if (res != FTI_SCES)
+    {
+        close(fd);
+        return FTI_NSCS;
+    }
+    if (close(fd) != 0)
+    {
+        FTI_Print("FTI checkpoint file could not be closed.", FTI_EROR);
+        return FTI_NSCS;
+    }
+    return FTI_SCES;
+}
+
+
+/** Checkpoint file, datasets and ranges of a parallel write.             */
+typedef struct FTIT_rangeJob {
+    int             fd;                 /** Checkpoint file descriptor.    */
+    FTIT_dataset    *data;              /** Dataset array.                 */
+    unsigned long   *offs;              /** File offset of each dataset.   */
+    unsigned long   rangeSize;          /** Size of the file ranges.       */
+} FTIT_rangeJob;
+
+
+/*-------------------------------------------------------------------------*/
+/**
+    @brief      It writes one byte range of the checkpoint file.
+    @param      arg             Parallel write (FTIT_rangeJob).
+    @param      task            Index of the range to write.
+    @return     integer         FTI_SCES if successful.
+
+    This function writes with pwrite the parts of the datasets that fall in
+    the given range of the checkpoint file. It is run by the threads of the
+    pool, each of them writing its own ranges.
+
+ **/
+/*-------------------------------------------------------------------------*/
+int FTI_WriteRange(void *arg, int task) {
+    FTIT_rangeJob *job = (FTIT_rangeJob *) arg;
+    unsigned long beg = task * job->rangeSize, end = beg + job->rangeSize, pos, len;
+    ssize_t written;
+    int i;
+    for (i = 0; i < FTI_Exec.nbVar; i++)
+    {
+        if (job->offs[i] + job->data[i].size <= beg || job->offs[i] >= end) continue;
+        pos = (beg > job->offs[i]) ? beg : job->offs[i];
+        len = ((end < job->offs[i] + job->data[i].size) ? end : job->offs[i] + job->data[i].size) - pos;
+        while (len > 0)
+        {
+            written = pwrite(job->fd, (char *) job->data[i].ptr + (pos - job->offs[i]), len, pos);
+            if (written < 0 && errno == EINTR) continue;
+            if (written <= 0)
+            { // Nothing written with bytes left, as on a full device
+                FTI_Print("Parallel write of the checkpoint failed.", FTI_EROR);
+                return FTI_NSCS;
+            }
+            pos = pos + written;
+            len = len - written;
+        }
+    }
+    return FTI_SCES;
+}
+
+
+/*-------------------------------------------------------------------------*/
+/**
+    @brief      It writes the checkpoint data from several threads.
+    @param      fn              Name of the checkpoint file.
+    @param      FTI_Data        Dataset array.
+    @return     integer         FTI_SCES if successful.
+
+    This function computes the file offset of each dataset from their sizes
+    and splits the checkpoint file in one byte range per I/O thread, with
+    page-aligned boundaries. The header is written first, then the ranges
+    are written concurrently by the thread pool with pwrite, after
+    preallocating the file.
+
+ **/
+/*-------------------------------------------------------------------------*/
+int FTI_WriteThreads(char *fn, FTIT_dataset* FTI_Data) {
+    unsigned long align = sysconf(_SC_PAGESIZE), total, hsize;
+    FTIT_rangeJob job;
+    char str[FTI_BUFS], *hdr;
+    int i, fd, res, nbRanges;
+    hdr = FTI_TocBuild(FTI_Data, &hsize);
+    if (hdr == NULL) return FTI_NSCS;
+    total = hsize;
+    job.offs = talloc(unsigned long, FTI_Exec.nbVar + 1);
+    for (i = 0; i < FTI_Exec.nbVar; i++)
+    {
+        job.offs[i] = total;
+        total = total + FTI_Data[i].size;
+    }
+    job.rangeSize = (total + FTI_Conf.ioThreads - 1) / FTI_Conf.ioThreads;
+    job.rangeSize = ((job.rangeSize + align - 1) / align) * align;
+    if (job.rangeSize == 0) job.rangeSize = align;
+    nbRanges = (total + job.rangeSize - 1) / job.rangeSize;
+    job.data = FTI_Data;
+    fd = open(fn, O_WRONLY | O_CREAT | O_TRUNC, 0666);
+    if (fd == -1)
+    {
+        FTI_Print("FTI checkpoint file could not be opened.", FTI_EROR);
+        free(job.offs);
+        free(hdr);
+        return FTI_NSCS;
+    }
+    res = posix_fallocate(fd, 0, total);
+    if (res != 0)
+    { // Not all file systems support preallocation
+        sprintf(str, "Checkpoint file could not be preallocated (%s).", strerror(res));
+        FTI_Print(str, FTI_DBUG);
+    }
+    job.fd = fd;
+    if (pwrite(fd, hdr, hsize, 0) != hsize)
+    {
+        FTI_Print("FTI checkpoint file header could not be written.", FTI_EROR);
+        res = FTI_NSCS;
+    } else {
+        res = FTI_PoolRun(FTI_WriteRange, &job, nbRanges);
+    }
+    free(job.offs);
+    free(hdr);
+    if (res != FTI_SCES)
+    {
+        close(fd);
+        return FTI_NSCS;
+    }
+    if (close(fd) != 0)
+    {
+        FTI_Print("FTI checkpoint file could not be closed.", FTI_EROR);
+        return FTI_NSCS;
+    }
+    return FTI_SCES;
+}
+
+
+/*-------------------------------------------------------------------------*/
+/**
+    @brief      It opens a file bypassing the page cache if possible.
+    @param      fn              Name of the file to open.
+    @param      flags           Open flags (without O_DIRECT).
+    @return     integer         File descriptor or -1 on failure.
+
+    This function opens the given file with O_DIRECT. If the file system
+    refuses direct I/O, the file is opened again through the page cache
+    and a warning is printed, so that the checkpoint can still be done.
+
+ **/
+/*-------------------------------------------------------------------------*/
+int FTI_OpenDirect(char *fn, int flags) {
+    char str[FTI_BUFS];
+    int fd = open(fn, flags | O_DIRECT, 0666);
+    if (fd == -1 && errno == EINVAL)
+    {
+        sprintf(str, "O_DIRECT refused for %s, using the page cache.", fn);
+        FTI_Print(str, FTI_WARN);
+        fd = open(fn, flags, 0666);
+    }
+    return fd;
+}
+
+
+/*-------------------------------------------------------------------------*/
+/**
+    @brief      It writes an aligned buffer to a file opened with O_DIRECT.
+    @param      fd              File descriptor of the target file.
+    @param      buf             Aligned buffer to write.
+    @param      size            Number of bytes to write (aligned).
+    @return     integer         FTI_SCES if successful.
+
+    This function writes the whole buffer, resuming partial writes. If the
+    file system rejects a direct write (EINVAL), or if a partial write
+    leaves the file offset unaligned, O_DIRECT is dropped from the file
+    descriptor and the rest of the buffer goes through the page cache.
+
+ **/
+/*-------------------------------------------------------------------------*/
+int FTI_WriteDirectBuf(int fd, char *buf, unsigned long size) {
+    unsigned long pos = 0;
+    long align = sysconf(_SC_PAGESIZE);
+    ssize_t written;
+    while (pos < size)
+    {
+        written = write(fd, buf + pos, size - pos);
+        if (written < 0)
+        {
+            if (errno == EINTR) continue;
+            if (errno == EINVAL && (fcntl(fd, F_GETFL) & O_DIRECT))
+            { // Direct I/O refused at write time
+                FTI_Print("O_DIRECT write refused, using the page cache.", FTI_WARN);
+                fcntl(fd, F_SETFL, fcntl(fd, F_GETFL) & ~O_DIRECT);
+                continue;
+            }
+            FTI_Print("Direct write of the checkpoint failed.", FTI_EROR);
+            return FTI_NSCS;
+        }
+        pos = pos + written;
+        if (pos % align != 0)
+        { // Keep going with buffered I/O after an unaligned partial write
+            fcntl(fd, F_SETFL, fcntl(fd, F_GETFL) & ~O_DIRECT);
+        }
+    }
+    return FTI_SCES;
+}
+
+
+/*-------------------------------------------------------------------------*/
+/**
+    @brief      It allocates a page-aligned staging buffer.
+    @param      size            Pointer to the requested size (updated).
+    @return     char*           Aligned buffer or NULL on failure.
+
+    This function rounds up the requested size to a multiple of the page
+    size and allocates a page-aligned buffer of that size, as required by
+    O_DIRECT transfers.
+
+ **/
+/*-------------------------------------------------------------------------*/
+char* FTI_AllocAligned(unsigned long *size) {
+    long align = sysconf(_SC_PAGESIZE);
+    void *buf;
+    *size = ((*size + align - 1) / align) * align;
+    if (posix_memalign(&buf, align, *size) != 0)
+    {
+        FTI_Print("Aligned staging buffer could not be allocated.", FTI_EROR);
+        return NULL;
+    }
+    return (char *) buf;
+}
+
+
+/*-------------------------------------------------------------------------*/
+/**
+    @brief      It writes the checkpoint data bypassing the page cache.
+    @param      fn              Name of the checkpoint file.
+    @param      FTI_Data        Dataset array.
+    @return     integer         FTI_SCES if successful.
+
+    This function copies the file header and the protected datasets into a
+    page-aligned staging buffer of one block and writes it with O_DIRECT
+    every time it is full.
+    The last block is padded up to the page size and the file is truncated
+    back to the real checkpoint size once everything has been written.
+
+ **/
+/*-------------------------------------------------------------------------*/
+int FTI_WriteDirect(char *fn, FTIT_dataset* FTI_Data) {
+    unsigned long bs = FTI_Conf.blockSize, fill = 0, pos, cpy, fs = 0, hsize, size;
+    long align = sysconf(_SC_PAGESIZE);
+    char *buf, *hdr, *src;
+    int i, fd;
+    hdr = FTI_TocBuild(FTI_Data, &hsize);
+    if (hdr == NULL) return FTI_NSCS;
+    buf = FTI_AllocAligned(&bs);
+    if (buf == NULL)
+    {
+        free(hdr);
+        return FTI_NSCS;
+    }
+    fd = FTI_OpenDirect(fn, O_WRONLY | O_CREAT | O_TRUNC);
+    if (fd == -1)
+    {
+        FTI_Print("FTI checkpoint file could not be opened.", FTI_EROR);
+        free(buf);
+        free(hdr);
+        return FTI_NSCS;
+    }
+    for (i = -1; i < (int) FTI_Exec.nbVar; i++)
+    { // Header first, then the datasets
+        src = (i < 0) ? hdr : (char *) FTI_Data[i].ptr;
+        size = (i < 0) ? hsize : FTI_Data[i].size;
+        pos = 0;
+        while (pos < size)
+        { // Fill the staging buffer and write it when full
+            cpy = ((size - pos) < (bs - fill)) ? size - pos : bs - fill;
+            memcpy(buf + fill, src + pos, cpy);
+            fill = fill + cpy;
+            pos = pos + cpy;
+            if (fill == bs)
+            {
+                if (FTI_WriteDirectBuf(fd, buf, bs) != FTI_SCES)
+                {
+                    close(fd);
+                    free(buf);
+                    free(hdr);
+                    return FTI_NSCS;
+                }
+                fs = fs + bs;
+                fill = 0;
+            }
+        }
+    }
+    if (fill > 0)
+    { // Padded tail
+        cpy = ((fill + align - 1) / align) * align;
+        memset(buf + fill, 0, cpy - fill);
+        if (FTI_WriteDirectBuf(fd, buf, cpy) != FTI_SCES)
+        {
+            close(fd);
+            free(buf);
+            free(hdr);
+            return FTI_NSCS;
+        }
+        fs = fs + fill;
+    }
+    free(buf);
+    free(hdr);
+    if (ftruncate(fd, fs) != 0)
+    {
+        FTI_Print("FTI checkpoint file could not be truncated.", FTI_EROR);
+        close(fd);
+        return FTI_NSCS;
+    }
+    if (close(fd) != 0)
+    {
+        FTI_Print("FTI checkpoint file could not be closed.", FTI_EROR);
+        return FTI_NSCS;
+    }
+    return FTI_SCES;
+}
+
+
+/*-------------------------------------------------------------------------*/
+/**
+    @brief      It copies a checkpoint file bypassing the page cache.
+    @param      src             Name of the source file.
+    @param      dst             Name of the destination file.
+    @param      fs              Size of the file to copy.
+    @return     integer         FTI_SCES if successful.
+
+    This function copies a checkpoint file block by block with O_DIRECT on
+    both sides, using a page-aligned staging buffer. The last block is
+    padded to the page size and the destination file is truncated back to
+    the real file size at the end.
+
+ **/
+/*-------------------------------------------------------------------------*/
+int FTI_CopyDirect(char *src, char *dst, unsigned long fs) {
+    unsigned long bs = FTI_Conf.blockSize, pos = 0, len;
+    long align = sysconf(_SC_PAGESIZE);
+    ssize_t rd;
+    int sfd, dfd;
+    char *buf;
+    buf = FTI_AllocAligned(&bs);
+    if (buf == NULL) return FTI_NSCS;
+    sfd = FTI_OpenDirect(src, O_RDONLY);
+    if (sfd == -1)
+    {
+        FTI_Print("Source ckpt. file could not be opened.", FTI_EROR);
+        free(buf);
+        return FTI_NSCS;
+    }
+    dfd = FTI_OpenDirect(dst, O_WRONLY | O_CREAT | O_TRUNC);
+    if (dfd == -1)
+    {
+        FTI_Print("Destination ckpt. file could not be opened.", FTI_EROR);
+        close(sfd);
+        free(buf);
+        return FTI_NSCS;
+    }
+    while (pos < fs)
+    { // Block by block copy
+        rd = read(sfd, buf, bs);
+        if (rd < 0 && errno == EINTR) continue;
+        if (rd < 0 && errno == EINVAL && (fcntl(sfd, F_GETFL) & O_DIRECT))
+        { // Direct read refused, drop O_DIRECT on the source
+            fcntl(sfd, F_SETFL, fcntl(sfd, F_GETFL) & ~O_DIRECT);
+            continue;
+        }
+        if (rd <= 0)
+        {
+            FTI_Print("Source ckpt. file could not be read.", FTI_EROR);
+            close(sfd);
+            close(dfd);
+            free(buf);
+            return FTI_NSCS;
+        }
+        len = ((rd + align - 1) / align) * align;
+        memset(buf + rd, 0, len - rd);
+        if (FTI_WriteDirectBuf(dfd, buf, len) != FTI_SCES)
+        {
+            close(sfd);
+            close(dfd);
+            free(buf);
+            return FTI_NSCS;
+        }
+        pos = pos + rd;
+        if (rd % align != 0 && pos < fs)
+        { // Short read in the middle of the file, keep offsets aligned
+            lseek(sfd, pos, SEEK_SET);
+            lseek(dfd, pos, SEEK_SET);
+            fcntl(sfd, F_SETFL, fcntl(sfd, F_GETFL) & ~O_DIRECT);
+            fcntl(dfd, F_SETFL, fcntl(dfd, F_GETFL) & ~O_DIRECT);
+        }
+    }
+    free(buf);
+    close(sfd);
+    if (ftruncate(dfd, fs) != 0)
+    {
+        FTI_Print("Destination ckpt. file could not be truncated.", FTI_EROR);
+        close(dfd);
+        return FTI_NSCS;
+    }
+    if (close(dfd) != 0)
+    {
+        FTI_Print("Destination ckpt. file could not be closed.", FTI_EROR);
+        return FTI_NSCS;
+    }
+    return FTI_SCES;
+}
+
+
+/*-------------------------------------------------------------------------*/
+/**
+    @brief      It maps a dataset of a checkpoint file in place.
+    @param      fd              Descriptor of the checkpoint file.
+    @param      data            Protected dataset to recover.
+    @param      off             Offset of the dataset in the file.
+    @return     integer         FTI_SCES if the dataset was mapped.
+
+    This function replaces the pages fully covered by the dataset buffer
+    with a private copy-on-write mapping of the checkpoint file, so that
+    they are read from the file only when the application touches them.
+    The buffer was marked by FTI_Mappable as starting on a page it owns,
+    the bytes after the last full page are read with pread. The dataset
+    must start on a page of the file too, otherwise nothing is done and
+    the caller reads the dataset as usual.
+
+ **/
+/*-------------------------------------------------------------------------*/
+int FTI_MapVar(int fd, FTIT_dataset *data, unsigned long off) {
+    unsigned long ps = sysconf(_SC_PAGESIZE), ptr = (unsigned long) data->ptr;
+    unsigned long end, tail;
+    end = (ptr + data->size) / ps * ps;
+    if (ptr % ps != 0 || off % ps != 0 || end <= ptr) return FTI_NSCS;
+    tail = ptr + data->size - end;
+    if (pread(fd, (char *) end, tail, off + data->size - tail) != tail) return FTI_NSCS;
+    if (mmap((void *) ptr, end - ptr, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_FIXED,
+             fd, off) == MAP_FAILED)
+    {
+        FTI_Print("Dataset could not be mapped from the checkpoint file.", FTI_WARN);
+        return FTI_NSCS;
+    }
+    return FTI_SCES;
+}
@@ -0,0 +1,384 @@
+/**
+ *  @file   mem.c
+ *  @author Leonardo A. Bautista Gomez (leobago@gmail.com)
+ *  @date   October, 2026
+ *  @brief  In-memory (L0) checkpoints for the FTI library.
+ */
+
+
+#include "fti.h"
+#include <fcntl.h>
+#include <sys/mman.h>
+
+
+/** Signature of the memory checkpoint segments.                           */
+static const char          FTI_MemMagic[8] = {'F','T','I','M','E','M','0','\0'};
+
+/** Segments of the local copy (0) and of the partner copy (1).            */
+static char                *FTI_MemSeg[2] = {NULL, NULL};
+
+/** Mapped size of the segments.                                           */
+static unsigned long       FTI_MemLen[2] = {0, 0};
+
+
+/*-------------------------------------------------------------------------*/
+/**
+    @brief      It gives the name of a memory checkpoint segment.
+    @param      name            Buffer to fill with the name.
+    @param      k               0 for the local copy, 1 for the partner one.
+    @return     void
+
+    The segments are named after the execution ID and the rank holding
+    them, so that a restarted process finds the ones of the failed run.
+
+ **/
+/*-------------------------------------------------------------------------*/
+void FTI_MemName(char *name, int k) {
+    snprintf(name, FTI_BUFS, "/fti-%s-L0-%s%d", FTI_Exec.id, (k == 0) ? "Rank" : "Pcof",
+             FTI_Topo.myRank);
+}
+
+
+/*-------------------------------------------------------------------------*/
+/**
+    @brief      It maps a memory checkpoint segment.
+    @param      k               0 for the local copy, 1 for the partner one.
+    @param      len             Size needed, 0 to map an existing segment.
+    @param      create          TRUE to create or grow the segment.
+    @return     integer         FTI_SCES if successful.
+
+    This function maps a POSIX shared memory segment, which outlives the
+    process and is only lost with the node. The segments stay mapped from
+    one checkpoint to the next and are only remapped when they must grow.
+    Their memory is allocated with posix_fallocate, so that running out of
+    memory is reported here instead of faulting during the copy.
+
+ **/
+/*-------------------------------------------------------------------------*/
+int FTI_MemMap(int k, unsigned long len, int create) {
+    char name[FTI_BUFS];
+    struct stat st;
+    void *seg;
+    int fd;
+    if (FTI_MemSeg[k] != NULL && FTI_MemLen[k] >= len) return FTI_SCES;
+    FTI_MemName(name, k);
+    fd = shm_open(name, create ? O_RDWR | O_CREAT : O_RDWR, 0600);
+    if (fd == -1) return FTI_NSCS;
+    if (fstat(fd, &st) != 0 || (st.st_size < len && (!create || posix_fallocate(fd, 0, len) != 0)))
+    {
+        FTI_Print("Memory checkpoint segment could not be allocated.", FTI_WARN);
+        close(fd);
+        return FTI_NSCS;
+    }
+    if (st.st_size > len) len = st.st_size;
+    if (len < FTI_MEM_HEAD)
+    {
+        close(fd);
+        return FTI_NSCS;
+    }
+    seg = mmap(NULL, len, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    close(fd);
+    if (seg == MAP_FAILED)
+    {
+        FTI_Print("Memory checkpoint segment could not be mapped.", FTI_WARN);
+        return FTI_NSCS;
+    }
+    if (FTI_MemSeg[k] != NULL) munmap(FTI_MemSeg[k], FTI_MemLen[k]);
+    FTI_MemSeg[k] = seg;
+    FTI_MemLen[k] = len;
+    return FTI_SCES;
+}
+
+
+/*-------------------------------------------------------------------------*/
+/**
+    @brief      It marks a memory checkpoint segment as valid.
+    @param      k               0 for the local copy, 1 for the partner one.
+    @param      id              Checkpoint ID.
+    @param      size            Size of the checkpoint image.
+    @return     void
+
+    The checkpoint ID is written last, a negative ID meaning that the
+    segment does not hold a usable checkpoint.
+
+ **/
+/*-------------------------------------------------------------------------*/
+void FTI_MemSeal(int k, int id, unsigned long size) {
+    FTIT_memheader *mh = (FTIT_memheader *) FTI_MemSeg[k];
+    memcpy(mh->magic, FTI_MemMagic, 8);
+    mh->rank = FTI_Topo.myRank;
+    mh->size = size;
+    mh->ckptID = id;
+}
+
+
+/*-------------------------------------------------------------------------*/
+/**
+    @brief      It checks the content of a memory checkpoint segment.
+    @param      k               0 for the local copy, 1 for the partner one.
+    @return     integer         Checkpoint ID, or -1 if not valid.
+
+    This function checks the segment header, the header of the checkpoint
+    image and the CRC32C of each dataset, if they were computed.
+
+ **/
+/*-------------------------------------------------------------------------*/
+int FTI_MemCheck(int k) {
+    FTIT_tocentry toc[FTI_BUFS];
+    FTIT_tocheader hdr;
+    FTIT_memheader *mh;
+    char *img;
+    FILE *fd;
+    int i, res;
+    if (FTI_MemSeg[k] == NULL) return -1;
+    mh = (FTIT_memheader *) FTI_MemSeg[k];
+    img = FTI_MemSeg[k] + FTI_MEM_HEAD;
+    if (memcmp(mh->magic, FTI_MemMagic, 8) != 0 || mh->ckptID < 0 ||
+        mh->size < sizeof(FTIT_tocheader) || mh->size > FTI_MemLen[k] - FTI_MEM_HEAD)
+    {
+        return -1;
+    }
+    fd = fmemopen(img, mh->size, "rb");
+    if (fd == NULL) return -1;
+    res = FTI_TocRead(fd, &hdr, toc);
+    fclose(fd);
+    if (res != 1) return -1;
+    for (i = 0; i < hdr.nbVar; i++)
+    {
+        if (toc[i].offset + toc[i].size > mh->size) return -1;
+        if ((hdr.flags & FTI_TOC_CRC) && FTI_Crc32c(0, img + toc[i].offset, toc[i].size) != toc[i].crc)
+        {
+            FTI_Print("Checksum mismatch in the memory checkpoint.", FTI_WARN);
+            return -1;
+        }
+    }
+    return mh->ckptID;
+}
+
+
+/*-------------------------------------------------------------------------*/
+/**
+    @brief      It exchanges checkpoint images with the ring partners.
+    @param      sbuf            Image sent to the right (dir 1) or left.
+    @param      ssize           Size to send, 0 for nothing.
+    @param      rbuf            Buffer for the image received.
+    @param      rsize           Size to receive, 0 for nothing.
+    @param      dir             1 to send right, -1 to send left.
+    @return     void
+
+    The images are sent in chunks of FTI_MEM_CHUNK bytes, so that the MPI
+    counts fit in an int.
+
+ **/
+/*-------------------------------------------------------------------------*/
+void FTI_MemSwap(char *sbuf, unsigned long ssize, char *rbuf, unsigned long rsize, int dir) {
+    unsigned long pos, scnt, rcnt;
+    int dest = (dir > 0) ? FTI_Topo.right : FTI_Topo.left;
+    int src = (dir > 0) ? FTI_Topo.left : FTI_Topo.right;
+    for (pos = 0; pos < ssize || pos < rsize; pos = pos + FTI_MEM_CHUNK)
+    {
+        scnt = (pos < ssize) ? ((ssize - pos < FTI_MEM_CHUNK) ? ssize - pos : FTI_MEM_CHUNK) : 0;
+        rcnt = (pos < rsize) ? ((rsize - pos < FTI_MEM_CHUNK) ? rsize - pos : FTI_MEM_CHUNK) : 0;
+        MPI_Sendrecv((scnt > 0) ? sbuf + pos : NULL, scnt, MPI_CHAR, dest, FTI_Conf.tag,
+                     (rcnt > 0) ? rbuf + pos : NULL, rcnt, MPI_CHAR, src, FTI_Conf.tag,
+                     FTI_Exec.groupComm, MPI_STATUS_IGNORE);
+    }
+}
+
+
+/*-------------------------------------------------------------------------*/
+/**
+    @brief      It takes a checkpoint in memory (L0).
+    @param      FTI_Data        Dataset array.
+    @param      id              Checkpoint ID.
+    @return     integer         FTI_SCES if successful.
+
+    This function copies the header and the datasets, in the checkpoint
+    file format, to the local memory segment and sends this image to the
+    right partner, which keeps it in its partner segment. No file is
+    written. The segments are marked valid only once all the processes have
+    their two copies, the previous memory checkpoint being lost if one of
+    them fails. The checksums and sizes of the last file checkpoint, kept
+    for its metadata, are left untouched.
+
+ **/
+/*-------------------------------------------------------------------------*/
+int FTI_MemCkpt(FTIT_dataset* FTI_Data, int id) {
+    FTIT_crcmeta crcMeta[FTI_BUFS];
+    unsigned int nbStored = FTI_Exec.nbStored, nbCrc = FTI_Exec.nbCrc;
+    unsigned long hsize, size, psize, pos;
+    int i, ok, pok, rok, res, tres;
+    char *hdr, *img;
+    memcpy(crcMeta, FTI_Exec.crcMeta, sizeof(crcMeta));
+    FTI_Exec.nbStored = 0;
+    FTI_Exec.nbCrc = 0;
+    hdr = FTI_TocBuild(FTI_Data, &hsize);
+    FTI_Exec.nbStored = nbStored;
+    FTI_Exec.nbCrc = nbCrc;
+    memcpy(FTI_Exec.crcMeta, crcMeta, sizeof(crcMeta));
+    size = hsize;
+    for (i = 0; i < FTI_Exec.nbVar; i++) size = size + FTI_Data[i].size;
+    ok = (hdr != NULL && FTI_MemMap(0, FTI_MEM_HEAD + size, 1) == FTI_SCES);
+    if (ok)
+    { // Local copy, not valid until the partner copy is done as well
+        ((FTIT_memheader *) FTI_MemSeg[0])->ckptID = -1;
+        img = FTI_MemSeg[0] + FTI_MEM_HEAD;
+        memcpy(img, hdr, hsize);
+        pos = hsize;
+        for (i = 0; i < FTI_Exec.nbVar; i++)
+        {
+            memcpy(img + pos, FTI_Data[i].ptr, FTI_Data[i].size);
+            pos = pos + FTI_Data[i].size;
+        }
+    }
+    free(hdr);
+    hsize = ok ? size : 0;
+    MPI_Sendrecv(&hsize, 1, MPI_UNSIGNED_LONG, FTI_Topo.right, FTI_Conf.tag,
+                 &psize, 1, MPI_UNSIGNED_LONG, FTI_Topo.left, FTI_Conf.tag,
+                 FTI_Exec.groupComm, MPI_STATUS_IGNORE);
+    pok = (psize > 0 && FTI_MemMap(1, FTI_MEM_HEAD + psize, 1) == FTI_SCES);
+    if (pok) ((FTIT_memheader *) FTI_MemSeg[1])->ckptID = -1;
+    MPI_Sendrecv(&pok, 1, MPI_INT, FTI_Topo.left, FTI_Conf.tag,
+                 &rok, 1, MPI_INT, FTI_Topo.right, FTI_Conf.tag,
+                 FTI_Exec.groupComm, MPI_STATUS_IGNORE);
+    FTI_MemSwap(FTI_MemSeg[0] + FTI_MEM_HEAD, (ok && rok) ? size : 0,
+                FTI_MemSeg[1] + FTI_MEM_HEAD, pok ? psize : 0, 1);
+    res = (ok && rok && pok) ? FTI_SCES : FTI_NSCS;
+    MPI_Allreduce(&res, &tres, 1, MPI_INT, MPI_SUM, FTI_COMM_WORLD);
+    if (tres != FTI_SCES) return FTI_NSCS;
+    FTI_MemSeal(0, id, size);
+    FTI_MemSeal(1, id, psize);
+    return FTI_SCES;
+}
+
+
+/*-------------------------------------------------------------------------*/
+/**
+    @brief      It invalidates the memory checkpoint.
+    @return     integer         FTI_SCES if successful.
+
+    This function is called when a file checkpoint is taken, as the memory
+    checkpoint is then older than the files and must not be recovered.
+
+ **/
+/*-------------------------------------------------------------------------*/
+int FTI_MemDrop() {
+    int k;
+    for (k = 0; k < 2; k++)
+    {
+        if (FTI_MemSeg[k] != NULL) ((FTIT_memheader *) FTI_MemSeg[k])->ckptID = -1;
+    }
+    return FTI_SCES;
+}
+
+
+/*-------------------------------------------------------------------------*/
+/**
+    @brief      It recovers the memory checkpoint after a failure.
+    @return     integer         FTI_SCES if all processes can use it.
+
+    This function maps the segments left by the failed execution. A process
+    whose local copy is lost or corrupted gets it back from the partner
+    segment of its right neighbour. The memory checkpoint is used only if
+    all the processes end up with a copy of the same checkpoint, otherwise
+    it is dropped and the recovery goes on with the file levels.
+
+ **/
+/*-------------------------------------------------------------------------*/
+int FTI_MemRecover() {
+    long info[2], rinfo[2];
+    int id, pid, need, lneed, got, lgot, lo, hi;
+    char str[FTI_BUFS];
+    FTI_MemMap(0, 0, 0);
+    FTI_MemMap(1, 0, 0);
+    id = FTI_MemCheck(0);
+    pid = FTI_MemCheck(1);
+    need = (id < 0);
+    MPI_Sendrecv(&need, 1, MPI_INT, FTI_Topo.right, FTI_Conf.tag,
+                 &lneed, 1, MPI_INT, FTI_Topo.left, FTI_Conf.tag,
+                 FTI_Exec.groupComm, MPI_STATUS_IGNORE);
+    info[0] = (lneed && pid >= 0) ? pid : -1;
+    info[1] = (info[0] >= 0) ? ((FTIT_memheader *) FTI_MemSeg[1])->size : 0;
+    MPI_Sendrecv(info, 2, MPI_LONG, FTI_Topo.left, FTI_Conf.tag,
+                 rinfo, 2, MPI_LONG, FTI_Topo.right, FTI_Conf.tag,
+                 FTI_Exec.groupComm, MPI_STATUS_IGNORE);
+    got = (need && rinfo[0] >= 0 && FTI_MemMap(0, FTI_MEM_HEAD + rinfo[1], 1) == FTI_SCES);
+    MPI_Sendrecv(&got, 1, MPI_INT, FTI_Topo.right, FTI_Conf.tag,
+                 &lgot, 1, MPI_INT, FTI_Topo.left, FTI_Conf.tag,
+                 FTI_Exec.groupComm, MPI_STATUS_IGNORE);
+    FTI_MemSwap(FTI_MemSeg[1] + FTI_MEM_HEAD, lgot ? info[1] : 0,
+                FTI_MemSeg[0] + FTI_MEM_HEAD, got ? rinfo[1] : 0, -1);
+    if (got)
+    { // Local copy rebuilt from the partner one
+        FTI_MemSeal(0, rinfo[0], rinfo[1]);
+        id = FTI_MemCheck(0);
+        sprintf(str, "Memory checkpoint %d restored from the partner copy.", id);
+        FTI_Print(str, FTI_DBUG);
+    }
+    MPI_Allreduce(&id, &lo, 1, MPI_INT, MPI_MIN, FTI_COMM_WORLD);
+    MPI_Allreduce(&id, &hi, 1, MPI_INT, MPI_MAX, FTI_COMM_WORLD);
+    if (lo < 0 || lo != hi)
+    {
+        FTI_MemDrop();
+        return FTI_NSCS;
+    }
+    FTI_Exec.ckptID = lo;
+    return FTI_SCES;
+}
+
+
+/*-------------------------------------------------------------------------*/
+/**
+    @brief      It loads the datasets from the memory checkpoint.
+    @param      FTI_Data        Dataset array.
+    @param      id              ID of the dataset to read, -1 for all.
+    @return     integer         FTI_SCES if successful.
+
+    This function reads the local copy recovered by FTI_MemRecover as a
+    memory stream, with the same lookup by ID as the checkpoint files.
+
+ **/
+/*-------------------------------------------------------------------------*/
+int FTI_MemRead(FTIT_dataset* FTI_Data, int id) {
+    FILE *fd;
+    int res;
+    if (FTI_MemSeg[0] == NULL || ((FTIT_memheader *) FTI_MemSeg[0])->ckptID < 0)
+    {
+        FTI_Print("There is no memory checkpoint to read.", FTI_EROR);
+        return FTI_NSCS;
+    }
+    fd = fmemopen(FTI_MemSeg[0] + FTI_MEM_HEAD, ((FTIT_memheader *) FTI_MemSeg[0])->size, "rb");
+    if (fd == NULL)
+    {
+        FTI_Print("Memory checkpoint could not be opened.", FTI_EROR);
+        return FTI_NSCS;
+    }
+    res = FTI_ReadCkptFd(fd, FTI_Data, id);
+    fclose(fd);
+    return res;
+}
+
+
+/*-------------------------------------------------------------------------*/
+/**
+    @brief      It releases the memory checkpoint.
+    @return     integer         FTI_SCES if successful.
+
+    This function unmaps and removes the two segments of the process, at
+    the end of the execution.
+
+ **/
+/*-------------------------------------------------------------------------*/
+int FTI_MemFree() {
+    char name[FTI_BUFS];
+    int k;
+    for (k = 0; k < 2; k++)
+    {
+        if (FTI_MemSeg[k] != NULL) munmap(FTI_MemSeg[k], FTI_MemLen[k]);
+        FTI_MemSeg[k] = NULL;
+        FTI_MemLen[k] = 0;
+        FTI_MemName(name, k);
+        shm_unlink(name);
+    }
+    return FTI_SCES;
+}
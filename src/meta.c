@@ -9,6 +9,35 @@
 #include "fti.h"
 
 
+/*-------------------------------------------------------------------------*/
+/**
+    @brief      It reads the checksums of a checkpoint file.
+    @param      ini             Metadata dictionary.
+    @param      rank            Rank in the group of the file owner.
+    @param      cm              Array to fill with the checksums.
+    @return     integer         Number of file parts with a checksum.
+
+    This function reads the size and the CRC32C of each part of the
+    checkpoint file of a process, as stored in the metadata file.
+
+ **/
+/*-------------------------------------------------------------------------*/
+int FTI_GetCrcMeta(dictionary *ini, int rank, FTIT_crcmeta *cm) {
+    char str[FTI_BUFS], *val;
+    int v;
+    for (v = 0; v < FTI_BUFS; v++)
+    {
+        sprintf(str, "%d:Crc%d_value", rank, v);
+        val = iniparser_getstring(ini, str, NULL);
+        if (val == NULL) break;
+        cm[v].crc = (unsigned int) strtoul(val, NULL, 16);
+        sprintf(str, "%d:Crc%d_size", rank, v);
+        cm[v].size = strtoul(iniparser_getstring(ini, str, "0"), NULL, 10);
+    }
+    return v;
+}
+
+
 /*-------------------------------------------------------------------------*/
 /**
     @brief      It gets the metadata to recover the data after a failure.
@@ -20,13 +49,16 @@
 
     This function read the metadata file created during checkpointing and
     recover the checkpoint file name, file size and the size of the largest
-    file in the group (for padding if ncessary during decoding).
+    file in the group (for padding if ncessary during decoding). It also
+    gets the word size of the L3 encoding (16 if not recorded), the
+    previous files of the incremental chain, the codecs of the compressed
+    datasets and the checksums of the file, if any.
 
  **/
 /*-------------------------------------------------------------------------*/
 int FTI_GetMeta(unsigned long *fs, unsigned long *mfs, int group, int level) {
     dictionary *ini;
-    int res = -1, cnt = 3;
+    int res = -1, cnt = 3, v;
     char mfn[FTI_BUFS], str[FTI_BUFS], *cfn;
     if(level == 0)
     {
@@ -60,6 +92,76 @@ int FTI_GetMeta(unsigned long *fs, unsigned long *mfs, int group, int level) {
     *fs = (int) iniparser_getint(ini, str, -1);
     sprintf(str, "%d:Ckpt_file_maxs", FTI_Topo.groupRank);
     *mfs = (int) iniparser_getint(ini, str, -1);
+    sprintf(str, "%d:Ckpt_word_size", FTI_Topo.groupRank);
+    FTI_Exec.l3WordSize = (int) iniparser_getint(ini, str, FTI_WORD);
+    sprintf(str, "%d:Ckpt_packet_size", FTI_Topo.groupRank);
+    FTI_Exec.l3PacketSize = (int) iniparser_getint(ini, str, 0);
+    sprintf(str, "%d:Ckpt_parity", FTI_Topo.groupRank);
+    FTI_Exec.l3Parity = (int) iniparser_getint(ini, str, FTI_Topo.groupSize);
+    sprintf(str, "%d:Ckpt_xor_parity", FTI_Topo.groupRank);
+    FTI_Exec.l3Xor = (int) iniparser_getint(ini, str, 0);
+    sprintf(str, "%d:Ckpt_chain", FTI_Topo.groupRank);
+    cfn = iniparser_getstring(ini, str, "");
+    snprintf(FTI_Exec.incChain, FTI_BUFS, "%s", cfn);
+    for (v = 0; v < FTI_BUFS; v++)
+    { // Compressed datasets, in file order
+        sprintf(str, "%d:Var%d_id", FTI_Topo.groupRank, v);
+        if (iniparser_getstring(ini, str, NULL) == NULL) break;
+        FTI_Exec.varMeta[v].id = (int) iniparser_getint(ini, str, -1);
+        sprintf(str, "%d:Var%d_codec", FTI_Topo.groupRank, v);
+        FTI_Exec.varMeta[v].codec = (int) iniparser_getint(ini, str, -1);
+        sprintf(str, "%d:Var%d_size", FTI_Topo.groupRank, v);
+        FTI_Exec.varMeta[v].size = strtoul(iniparser_getstring(ini, str, "0"), NULL, 10);
+        sprintf(str, "%d:Var%d_bound", FTI_Topo.groupRank, v);
+        FTI_Exec.varMeta[v].bound = iniparser_getdouble(ini, str, 0);
+    }
+    FTI_Exec.nbStored = v;
+    FTI_Exec.nbCrc = FTI_GetCrcMeta(ini, FTI_Topo.groupRank, FTI_Exec.crcMeta);
+    iniparser_freedict(ini);
+    return FTI_SCES;
+}
+
+
+/*-------------------------------------------------------------------------*/
+/**
+    @brief      It gets the checkpoint file size of the partner process.
+    @param      pfs             Pointer to fill the partner file size.
+    @param      pnb             Pointer to fill the number of checksums.
+    @param      pcm             Array to fill with the checksums.
+    @param      group           The group in the node.
+    @param      level           The level of the ckpt or 0 if tmp.
+    @return     integer         FTI_SCES if successfull.
+
+    This function reads the size of the checkpoint file of the process on
+    the left of the ring, whose copy is kept in the partner file at L2, and
+    its checksums if pnb and pcm are not NULL.
+
+ **/
+/*-------------------------------------------------------------------------*/
+int FTI_GetPtnerSize(unsigned long *pfs, unsigned int *pnb, FTIT_crcmeta *pcm, int group, int level) {
+    dictionary *ini;
+    char mfn[FTI_BUFS], str[FTI_BUFS];
+    if(level == 0)
+    {
+        sprintf(mfn,"%s/sector%d-group%d.fti",FTI_Conf.mTmpDir, FTI_Topo.sectorID, group);
+    }
+    else {
+        sprintf(mfn,"%s/sector%d-group%d.fti",FTI_Ckpt[level].metaDir, FTI_Topo.sectorID, group);
+    }
+    if (access(mfn, R_OK) != 0)
+    {
+        FTI_Print("FTI metadata file NOT accessible.", FTI_DBUG);
+        return FTI_NSCS;
+    }
+    ini = iniparser_load(mfn);
+    if (ini == NULL)
+    {
+        FTI_Print("Iniparser failed to parse the metadata file.", FTI_WARN);
+        return FTI_NSCS;
+    }
+    sprintf(str, "%d:Ckpt_file_size", FTI_Topo.left);
+    *pfs = (int) iniparser_getint(ini, str, -1);
+    if (pnb != NULL && pcm != NULL) *pnb = FTI_GetCrcMeta(ini, FTI_Topo.left, pcm);
     iniparser_freedict(ini);
     return FTI_SCES;
 }
@@ -71,17 +173,25 @@ int FTI_GetMeta(unsigned long *fs, unsigned long *mfs, int group, int level) {
     @param      fs              Pointer to the list of checkpoint sizes.
     @param      mfs             The maximum checkpoint file size.
     @param      fnl             Pointer to the list of checkpoint names.
+    @param      chl             Pointer to the list of incremental chains.
+    @param      nbl             Pointer to the list of compressed dataset counts.
+    @param      vml             Pointer to the list of compressed datasets.
+    @param      ncl             Pointer to the list of checksum counts.
+    @param      cml             Pointer to the list of checksums.
     @return     integer         FTI_SCES if successfull.
 
     This function should be executed only by one process per group. It
-    writes the metadata file used to recover in case of failure.
+    writes the metadata file used to recover in case of failure. For L3,
+    the word size of the encoding is recorded as well.
 
  **/
 /*-------------------------------------------------------------------------*/
-int FTI_WriteMetadata(unsigned long *fs, unsigned long mfs, char* fnl) {
+int FTI_WriteMetadata(unsigned long *fs, unsigned long mfs, char* fnl, char* chl,
+                      unsigned int *nbl, FTIT_varmeta *vml, unsigned int *ncl, FTIT_crcmeta *cml) {
     char str[FTI_BUFS], buf[FTI_BUFS];
+    FTIT_varmeta *vm;
     dictionary *ini;
-    int i;
+    int i, v;
     snprintf(buf, FTI_BUFS, "%s/Topology.fti",FTI_Conf.metadDir);
     sprintf(str, "Temporary load of topology file (%s)...", buf);
     FTI_Print(str, FTI_DBUG);
@@ -104,6 +214,55 @@ int FTI_WriteMetadata(unsigned long *fs, unsigned long mfs, char* fnl) {
         sprintf(str,"%d:Ckpt_file_maxs", i);
         sprintf(buf,"%ld", mfs);
         iniparser_set(ini, str, buf);
+        if (FTI_Exec.ckptLvel == 3)
+        { // Galois field, packet size and number of the encoded files, or XOR parity
+            sprintf(str,"%d:Ckpt_word_size", i);
+            sprintf(buf,"%d", FTI_Conf.l3WordSize);
+            iniparser_set(ini, str, buf);
+            sprintf(str,"%d:Ckpt_packet_size", i);
+            sprintf(buf,"%d", FTI_Conf.l3PacketSize);
+            iniparser_set(ini, str, buf);
+            sprintf(str,"%d:Ckpt_parity", i);
+            sprintf(buf,"%d", FTI_Conf.l3Parity);
+            iniparser_set(ini, str, buf);
+            sprintf(str,"%d:Ckpt_xor_parity", i);
+            sprintf(buf,"%d", FTI_Conf.l3Xor);
+            iniparser_set(ini, str, buf);
+        }
+        if (chl[i*FTI_BUFS] != '\0')
+        { // Base and previous deltas of an incremental checkpoint
+            strncpy(buf,chl+(i*FTI_BUFS),FTI_BUFS);
+            sprintf(str,"%d:Ckpt_chain", i);
+            iniparser_set(ini, str, buf);
+        }
+        for (v = 0; v < nbl[i]; v++)
+        { // Codec, stored size and error bound of the compressed datasets
+            vm = &vml[i*FTI_BUFS+v];
+            sprintf(str,"%d:Var%d_id", i, v);
+            sprintf(buf,"%d", vm->id);
+            iniparser_set(ini, str, buf);
+            sprintf(str,"%d:Var%d_codec", i, v);
+            sprintf(buf,"%d", vm->codec);
+            iniparser_set(ini, str, buf);
+            sprintf(str,"%d:Var%d_size", i, v);
+            sprintf(buf,"%lu", vm->size);
+            iniparser_set(ini, str, buf);
+            if (vm->bound != 0)
+            { // Error bound of a lossy dataset
+                sprintf(str,"%d:Var%d_bound", i, v);
+                sprintf(buf,"%.17g", vm->bound);
+                iniparser_set(ini, str, buf);
+            }
+        }
+        for (v = 0; v < ncl[i]; v++)
+        { // Size and CRC32C of each part of the file
+            sprintf(str,"%d:Crc%d_size", i, v);
+            sprintf(buf,"%lu", cml[i*FTI_BUFS+v].size);
+            iniparser_set(ini, str, buf);
+            sprintf(str,"%d:Crc%d_value", i, v);
+            sprintf(buf,"%08x", cml[i*FTI_BUFS+v].crc);
+            iniparser_set(ini, str, buf);
+        }
     }
     iniparser_unset(ini, "topology"); // Remove topology section
     if (access(FTI_Conf.mTmpDir, F_OK) != 0)
@@ -146,13 +305,18 @@ int FTI_WriteMetadata(unsigned long *fs, unsigned long mfs, char* fnl) {
     @return     integer         FTI_SCES if successfull.
 
     This function gathers information about the checkpoint files in the
-    group (name and sizes), and creates the metadata file used to recover in
-    case of failure.
+    group (name, sizes, compressed datasets and checksums), and creates
+    the metadata file used to recover in case of failure.
 
  **/
 /*-------------------------------------------------------------------------*/
 int FTI_CreateMetadata(int globalTmp) {
     char *fnl = talloc(char, FTI_Topo.groupSize*FTI_BUFS);
+    char *chl = talloc(char, FTI_Topo.groupSize*FTI_BUFS);
+    unsigned int *nbl = talloc(unsigned int, FTI_Topo.groupSize);
+    FTIT_varmeta *vml = talloc(FTIT_varmeta, FTI_Topo.groupSize*FTI_BUFS);
+    unsigned int *ncl = talloc(unsigned int, FTI_Topo.groupSize);
+    FTIT_crcmeta *cml = talloc(FTIT_crcmeta, FTI_Topo.groupSize*FTI_BUFS);
     unsigned long fs[FTI_BUFS], mfs, tmpo;
     char str[FTI_BUFS], buf[FTI_BUFS];
     struct stat fileStatus;
@@ -169,6 +333,11 @@ int FTI_CreateMetadata(int globalTmp) {
     } else {
         FTI_Print("Error with stat on the checkpoint file.", FTI_WARN);
         free(fnl);
+        free(chl);
+        free(nbl);
+        free(vml);
+        free(ncl);
+        free(cml);
         return FTI_NSCS;
     }
     sprintf(str, "Checkpoint file size : %ld bytes.", fs[FTI_Topo.groupRank]);
@@ -178,6 +347,13 @@ int FTI_CreateMetadata(int globalTmp) {
     MPI_Allgather(&tmpo, 1, MPI_UNSIGNED_LONG, fs, 1, MPI_UNSIGNED_LONG, FTI_Exec.groupComm);
     strncpy(str,fnl+(FTI_Topo.groupRank*FTI_BUFS),FTI_BUFS); // Gather all the file names
     MPI_Allgather(str, FTI_BUFS, MPI_CHAR, fnl, FTI_BUFS, MPI_CHAR, FTI_Exec.groupComm);
+    MPI_Allgather(FTI_Exec.incChain, FTI_BUFS, MPI_CHAR, chl, FTI_BUFS, MPI_CHAR, FTI_Exec.groupComm);
+    MPI_Allgather(&FTI_Exec.nbStored, 1, MPI_UNSIGNED, nbl, 1, MPI_UNSIGNED, FTI_Exec.groupComm);
+    MPI_Allgather(FTI_Exec.varMeta, FTI_BUFS*sizeof(FTIT_varmeta), MPI_BYTE,
+                  vml, FTI_BUFS*sizeof(FTIT_varmeta), MPI_BYTE, FTI_Exec.groupComm);
+    MPI_Allgather(&FTI_Exec.nbCrc, 1, MPI_UNSIGNED, ncl, 1, MPI_UNSIGNED, FTI_Exec.groupComm);
+    MPI_Allgather(FTI_Exec.crcMeta, FTI_BUFS*sizeof(FTIT_crcmeta), MPI_BYTE,
+                  cml, FTI_BUFS*sizeof(FTIT_crcmeta), MPI_BYTE, FTI_Exec.groupComm);
     mfs = 0;
     for(i = 0; i < FTI_Topo.groupSize; i++)
     {
@@ -190,14 +366,24 @@ int FTI_CreateMetadata(int globalTmp) {
     FTI_Print(str, FTI_DBUG);
     if (FTI_Topo.groupRank == 0)
     { // Only one process in the group create the metadata
-        int res = FTI_Try(FTI_WriteMetadata(fs, mfs, fnl), "write the metadata.");
+        int res = FTI_Try(FTI_WriteMetadata(fs, mfs, fnl, chl, nbl, vml, ncl, cml), "write the metadata.");
         if (res == FTI_NSCS)
         {
             free(fnl);
+            free(chl);
+            free(nbl);
+            free(vml);
+            free(ncl);
+            free(cml);
             return FTI_NSCS;
         }
     }
     free(fnl);
+    free(chl);
+    free(nbl);
+    free(vml);
+    free(ncl);
+    free(cml);
     return FTI_SCES;
 }
 
@@ -0,0 +1,211 @@
+/**
+ *  @file   pool.c
+ *  @author Leonardo A. Bautista Gomez (leobago@gmail.com)
+ *  @date   October, 2026
+ *  @brief  Worker thread pool for the FTI library.
+ */
+
+
+#include "fti.h"
+#include <pthread.h>
+
+
+/** Worker threads of the pool.                                            */
+static pthread_t           *FTI_PoolThreads = NULL;
+
+/** Number of worker threads in the pool.                                  */
+static int                 FTI_PoolSize = 0;
+
+/** Lock and conditions of the pool (new tasks and finished job).          */
+static pthread_mutex_t     FTI_PoolLock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t      FTI_PoolCond = PTHREAD_COND_INITIALIZER;
+static pthread_cond_t      FTI_PoolDone = PTHREAD_COND_INITIALIZER;
+
+/** Lock serializing the jobs given to the pool.                           */
+static pthread_mutex_t     FTI_PoolRunLock = PTHREAD_MUTEX_INITIALIZER;
+
+/** Task function and argument of the current job.                         */
+static int                 (*FTI_PoolFunc)(void *arg, int task) = NULL;
+static void                *FTI_PoolArg = NULL;
+
+/** Number of tasks, next task to start and tasks not finished yet.        */
+static int                 FTI_PoolTasks = 0;
+static int                 FTI_PoolNext = 0;
+static int                 FTI_PoolLeft = 0;
+
+/** Result of the current job.                                             */
+static int                 FTI_PoolRes = FTI_SCES;
+
+/** TRUE if the workers have been asked to stop.                           */
+static int                 FTI_PoolEnd = 0;
+
+
+/*-------------------------------------------------------------------------*/
+/**
+    @brief      It runs the tasks of the current job until there is none.
+    @return     void
+
+    This function takes the tasks of the current job one by one and runs
+    them. It is called with the pool lock held, by the workers and by the
+    thread that gave the job, and returns with the lock held.
+
+ **/
+/*-------------------------------------------------------------------------*/
+void FTI_PoolDrain() {
+    int task, res;
+    while (FTI_PoolNext < FTI_PoolTasks)
+    {
+        task = FTI_PoolNext++;
+        pthread_mutex_unlock(&FTI_PoolLock);
+        res = FTI_PoolFunc(FTI_PoolArg, task);
+        pthread_mutex_lock(&FTI_PoolLock);
+        if (res != FTI_SCES) FTI_PoolRes = FTI_NSCS;
+        FTI_PoolLeft--;
+        if (FTI_PoolLeft == 0) pthread_cond_broadcast(&FTI_PoolDone);
+    }
+}
+
+
+/*-------------------------------------------------------------------------*/
+/**
+    @brief      Main loop of the worker threads.
+    @param      arg             Unused.
+    @return     void*           NULL.
+
+    This function waits for jobs and runs their tasks until FTI_PoolStop is
+    called.
+
+ **/
+/*-------------------------------------------------------------------------*/
+void* FTI_PoolLoop(void *arg) {
+    pthread_mutex_lock(&FTI_PoolLock);
+    while (1)
+    {
+        while (FTI_PoolNext >= FTI_PoolTasks && !FTI_PoolEnd)
+        {
+            pthread_cond_wait(&FTI_PoolCond, &FTI_PoolLock);
+        }
+        if (FTI_PoolEnd) break;
+        FTI_PoolDrain();
+    }
+    pthread_mutex_unlock(&FTI_PoolLock);
+    return NULL;
+}
+
+
+/*-------------------------------------------------------------------------*/
+/**
+    @brief      It starts the worker threads.
+    @param      nbThreads       Number of threads working on each job.
+    @return     integer         FTI_SCES if successful.
+
+    This function starts nbThreads-1 worker threads, the thread giving a
+    job being the last one. The workers stay idle between the jobs so that
+    they are reused by all the checkpoints. If a thread cannot be created,
+    the pool works with the threads already started.
+
+ **/
+/*-------------------------------------------------------------------------*/
+int FTI_PoolInit(int nbThreads) {
+    char str[FTI_BUFS];
+    int i;
+    if (FTI_PoolSize > 0 || nbThreads < 2) return FTI_SCES;
+    FTI_PoolThreads = talloc(pthread_t, nbThreads - 1);
+    FTI_PoolEnd = 0;
+    FTI_PoolTasks = 0;
+    FTI_PoolNext = 0;
+    for (i = 0; i < nbThreads - 1; i++)
+    {
+        if (pthread_create(&FTI_PoolThreads[i], NULL, FTI_PoolLoop, NULL) != 0)
+        {
+            sprintf(str, "Only %d of %d I/O threads could be created.", i + 1, nbThreads);
+            FTI_Print(str, FTI_WARN);
+            break;
+        }
+    }
+    FTI_PoolSize = i;
+    if (FTI_PoolSize == 0)
+    {
+        free(FTI_PoolThreads);
+        FTI_PoolThreads = NULL;
+        return FTI_NSCS;
+    }
+    sprintf(str, "Thread pool started with %d worker threads.", FTI_PoolSize);
+    FTI_Print(str, FTI_DBUG);
+    return FTI_SCES;
+}
+
+
+/*-------------------------------------------------------------------------*/
+/**
+    @brief      It runs a job on the thread pool.
+    @param      func            Task function, called once per task.
+    @param      arg             Argument given to the task function.
+    @param      nbTasks         Number of tasks of the job.
+    @return     integer         FTI_SCES if all the tasks succeeded.
+
+    This function hands the tasks 0 to nbTasks-1 to the workers, runs tasks
+    in the calling thread as well and returns when all of them are done.
+    Without workers, all the tasks are run by the calling thread. Jobs
+    given by several threads at the same time are run one after the other.
+
+ **/
+/*-------------------------------------------------------------------------*/
+int FTI_PoolRun(int (*func)(void *arg, int task), void *arg, int nbTasks) {
+    int i, res = FTI_SCES;
+    if (FTI_PoolSize == 0 || nbTasks < 2)
+    {
+        for (i = 0; i < nbTasks; i++)
+        {
+            if (func(arg, i) != FTI_SCES) res = FTI_NSCS;
+        }
+        return res;
+    }
+    pthread_mutex_lock(&FTI_PoolRunLock);
+    pthread_mutex_lock(&FTI_PoolLock);
+    FTI_PoolFunc = func;
+    FTI_PoolArg = arg;
+    FTI_PoolRes = FTI_SCES;
+    FTI_PoolLeft = nbTasks;
+    FTI_PoolNext = 0;
+    FTI_PoolTasks = nbTasks;
+    pthread_cond_broadcast(&FTI_PoolCond);
+    FTI_PoolDrain();
+    while (FTI_PoolLeft > 0)
+    {
+        pthread_cond_wait(&FTI_PoolDone, &FTI_PoolLock);
+    }
+    res = FTI_PoolRes;
+    pthread_mutex_unlock(&FTI_PoolLock);
+    pthread_mutex_unlock(&FTI_PoolRunLock);
+    return res;
+}
+
+
+/*-------------------------------------------------------------------------*/
+/**
+    @brief      It stops the worker threads.
+    @return     integer         FTI_SCES if successful.
+
+    This function wakes up the idle workers, asks them to stop and joins
+    them.
+
+ **/
+/*-------------------------------------------------------------------------*/
+int FTI_PoolStop() {
+    int i;
+    if (FTI_PoolSize == 0) return FTI_SCES;
+    pthread_mutex_lock(&FTI_PoolLock);
+    FTI_PoolEnd = 1;
+    pthread_cond_broadcast(&FTI_PoolCond);
+    pthread_mutex_unlock(&FTI_PoolLock);
+    for (i = 0; i < FTI_PoolSize; i++)
+    {
+        pthread_join(FTI_PoolThreads[i], NULL);
+    }
+    free(FTI_PoolThreads);
+    FTI_PoolThreads = NULL;
+    FTI_PoolSize = 0;
+    FTI_Print("Thread pool stopped.", FTI_DBUG);
+    return FTI_SCES;
+}
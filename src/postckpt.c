@@ -7,6 +7,45 @@
 
 
 #include "fti.h"
+#include <pthread.h>
+
+
+/** Local checkpoint file written while the data is sent from memory.     */
+typedef struct FTIT_fileJob {
+    char            *fn;                /** Checkpoint file name.          */
+    FTIT_dataset    *data;              /** Dataset array.                 */
+    pthread_t       thread;             /** Thread writing the file.       */
+    int             res;                /** Result of the write.           */
+} FTIT_fileJob;
+
+
+/** Encoding context of the group, for each word size: Cauchy matrix,
+    bitmatrix and XOR schedule of the encoded file of this process.       */
+static int                 *FTI_RSmat[33];
+static int                 *FTI_RSbits[33];
+static int                 **FTI_RSsched[33];
+
+/** XOR schedule of the shares of this process in the encoded files.      */
+static int                 **FTI_RScolSched[33];
+
+/** TRUE while the thread pool writes the checkpoint file.                 */
+static int                 FTI_RSbusy = 0;
+
+
+/** Region work of the L3 encoding, split in slices for the thread pool.   */
+typedef struct FTIT_rsJob {
+    char            **data;             /** Checkpoint blocks.             */
+    int             k;                  /** Number of checkpoint blocks.   */
+    int             *row;               /** Factors, m rows of k.          */
+    int             **schedule;         /** XOR schedule, or NULL.         */
+    int             w;                  /** Word size of the field.        */
+    int             pk;                 /** Packet size of the schedule.   */
+    char            **coding;           /** Encoded blocks.                */
+    int             m;                  /** Number of encoded blocks.      */
+    int             add;                /** TRUE to add to encoded blocks. */
+    int             bs;                 /** Size of the blocks.            */
+    int             slice;              /** Size of the slices.            */
+} FTIT_rsJob;
 
 
 /*-------------------------------------------------------------------------*/
@@ -36,24 +75,28 @@ int FTI_Local(int group) {
 
   This function copies the checkpoint files into the pertner node. It
   follows a ring, where the ring size is the group size given in the FTI
-  configuration file.
+  configuration file. The partner file gets the size of the checkpoint
+  file of the left process, which may differ from the local one. The
+  blocks go through FTI_PtnerRing. If the copy was already sent from
+  memory by FTI_WritePtner, there is nothing left to do.
 
  **/
 /*-------------------------------------------------------------------------*/
 int FTI_Ptner(int group) {
-    char        *blBuf1, *blBuf2, lfn[FTI_BUFS], pfn[FTI_BUFS], str[FTI_BUFS];
-    unsigned long maxFs, fs, ps, pos = 0;
-    MPI_Request reqSend, reqRecv;
-    FILE        *lfd, *pfd;
-    int         res, dest, src, bSize = FTI_Conf.blockSize;
-    MPI_Status  status;
+    char lfn[FTI_BUFS], pfn[FTI_BUFS], str[FTI_BUFS];
+    unsigned long maxFs, fs;
+    FILE *lfd, *pfd;
+    int res, src;
 
     FTI_Print("Starting checkpoint post-processing L2", FTI_DBUG);
     res = FTI_Try(FTI_GetMeta(&fs, &maxFs, group, 0), "obtain metadata.");
     if (res == FTI_NSCS) return FTI_NSCS;
-    ps = (maxFs/FTI_Conf.blockSize)*FTI_Conf.blockSize;
-    if (ps < maxFs) ps = ps + FTI_Conf.blockSize;
-    sprintf(str, "Max. file size %ld and padding size %ld.", maxFs, ps);
+    if (FTI_Exec.postDone)
+    {
+        FTI_Print("L2 partner copy already sent from memory.", FTI_DBUG);
+        return FTI_SCES;
+    }
+    sprintf(str, "Max. file size %ld and pipeline depth %d.", maxFs, FTI_Conf.pipeDepth);
     FTI_Print(str, FTI_DBUG);
 
     sscanf(FTI_Exec.ckptFile,"Ckpt%d-Rank%d.fti", &FTI_Exec.ckptID, &src);
@@ -64,34 +107,652 @@ int FTI_Ptner(int group) {
     FTI_Print(str, FTI_DBUG);
     res = FTI_Try(access(lfn, R_OK), " access the L2 checkpoint file.");
     if (res == FTI_NSCS) return FTI_NSCS;
-    dest = FTI_Topo.right;
-    src = FTI_Topo.left;
 
     lfd = fopen(lfn, "rb");
     pfd = fopen(pfn, "wb");
     if (lfd == NULL) { FTI_Print("FTI failed to open L2 chckpt. file.", FTI_DBUG); return FTI_NSCS; }
     if (pfd == NULL) { FTI_Print("FTI failed to open L2 partner file.", FTI_DBUG); return FTI_NSCS; }
-    blBuf1 = talloc(char, FTI_Conf.blockSize);
-    blBuf2 = talloc(char, FTI_Conf.blockSize);
-    while(pos < ps)
-    { // Checkpoint files partner copy
-        if ((fs-pos) < FTI_Conf.blockSize) bSize = fs - pos;
-        fread(blBuf1, sizeof(char), bSize, lfd);
-        MPI_Isend(blBuf1, FTI_Conf.blockSize, MPI_CHAR, dest, FTI_Conf.tag, FTI_Exec.groupComm, &reqSend);
-        MPI_Irecv(blBuf2, FTI_Conf.blockSize, MPI_CHAR, src, FTI_Conf.tag, FTI_Exec.groupComm, &reqRecv);
-        MPI_Wait(&reqSend, &status);
-        MPI_Wait(&reqRecv, &status);
-        fwrite(blBuf2, sizeof(char), bSize, pfd);
-        pos = pos + FTI_Conf.blockSize;
-    }
-    free(blBuf1);
-    free(blBuf2);
+    res = FTI_PtnerRing(lfd, NULL, 0, NULL, fs, maxFs, pfd);
     fclose(lfd);
-    fclose(pfd);
+    if (fclose(pfd) != 0) res = FTI_NSCS;
+    return res;
+}
+
+
+/*-------------------------------------------------------------------------*/
+/**
+  @brief      It writes the local checkpoint file from a thread.
+  @param      arg             Local file to write (FTIT_fileJob).
+  @return     void*           NULL.
+
+  This function runs FTI_WriteFull while the data is sent from memory. It
+  does not call MPI.
+
+ **/
+/*-------------------------------------------------------------------------*/
+void* FTI_WriteLocal(void *arg) {
+    FTIT_fileJob *job = (FTIT_fileJob *) arg;
+    job->res = FTI_WriteFull(job->fn, job->data);
+    return NULL;
+}
+
+
+/*-------------------------------------------------------------------------*/
+/**
+  @brief      It starts writing the local checkpoint file.
+  @param      job             Local file to write.
+  @param      fn              Name of the checkpoint file.
+  @param      FTI_Data        Dataset array.
+  @param      hsize           Pointer to fill with the header size.
+  @param      fs              Pointer to fill with the checkpoint size.
+  @param      maxFs           Pointer to fill with the largest size of the group.
+  @return     char*           Header of the checkpoint, NULL on failure.
+
+  This function builds the header of the checkpoint file, as written by
+  FTI_WriteFull, and starts the thread writing the file. The checkpoint
+  sizes are exchanged in the group in any case. On failure, the checkpoint
+  size is 0 so that the process only receives.
+
+ **/
+/*-------------------------------------------------------------------------*/
+char* FTI_WriteStart(FTIT_fileJob *job, char *fn, FTIT_dataset* FTI_Data,
+                     unsigned long *hsize, unsigned long *fs, unsigned long *maxFs) {
+    char *hdr;
+    int i;
+    hdr = FTI_TocBuild(FTI_Data, hsize);
+    *fs = *hsize;
+    for (i = 0; i < FTI_Exec.nbVar; i++) *fs = *fs + FTI_Data[i].size;
+    MPI_Allreduce(fs, maxFs, 1, MPI_UNSIGNED_LONG, MPI_MAX, FTI_Exec.groupComm);
+    job->fn = fn;
+    job->data = FTI_Data;
+    job->res = FTI_NSCS;
+    if (hdr != NULL && pthread_create(&job->thread, NULL, FTI_WriteLocal, job) != 0)
+    {
+        free(hdr);
+        hdr = NULL;
+    }
+    if (hdr == NULL)
+    { // Nothing to send, but the others still expect our blocks
+        FTI_Print("Local checkpoint file could not be written from a thread.", FTI_EROR);
+        *fs = 0;
+    }
+    return hdr;
+}
+
+
+/*-------------------------------------------------------------------------*/
+/**
+  @brief      It waits for the local checkpoint file.
+  @param      job             Local file being written.
+  @param      hdr             Header returned by FTI_WriteStart.
+  @return     integer         FTI_SCES if the file was written.
+
+ **/
+/*-------------------------------------------------------------------------*/
+int FTI_WriteJoin(FTIT_fileJob *job, char *hdr) {
+    if (hdr == NULL) return FTI_NSCS;
+    pthread_join(job->thread, NULL);
+    free(hdr);
+    return job->res;
+}
+
+
+/*-------------------------------------------------------------------------*/
+/**
+  @brief      It copies a block of the checkpoint image to a buffer.
+  @param      buf             Target buffer of bs bytes.
+  @param      hdr             Header of the checkpoint file.
+  @param      hsize           Size of the header.
+  @param      FTI_Data        Dataset array.
+  @param      fs              Size of the checkpoint.
+  @param      pos             Offset of the block in the checkpoint file.
+  @param      bs              Size of the block.
+  @return     integer         Number of bytes of the checkpoint copied.
+
+  This function copies the part of the header and the datasets found at
+  the given offset of the checkpoint file. The rest of the block, past the
+  end of the checkpoint, is filled with zeros.
+
+ **/
+/*-------------------------------------------------------------------------*/
+unsigned long FTI_ImageCopy(char *buf, char *hdr, unsigned long hsize, FTIT_dataset* FTI_Data,
+                            unsigned long fs, unsigned long pos, unsigned long bs) {
+    unsigned long off = hsize, len, beg, end;
+    int i;
+    len = (pos < fs) ? ((fs - pos < bs) ? fs - pos : bs) : 0;
+    memset(buf + len, 0, bs - len);
+    if (len == 0) return 0;
+    if (pos < hsize)
+    {
+        end = (pos + len < hsize) ? pos + len : hsize;
+        memcpy(buf, hdr + pos, end - pos);
+    }
+    for (i = 0; i < FTI_Exec.nbVar && off < pos + len; i++)
+    {
+        if (off + FTI_Data[i].size > pos)
+        {
+            beg = (pos > off) ? pos : off;
+            end = (pos + len < off + FTI_Data[i].size) ? pos + len : off + FTI_Data[i].size;
+            memcpy(buf + (beg - pos), (char *) FTI_Data[i].ptr + (beg - off), end - beg);
+        }
+        off = off + FTI_Data[i].size;
+    }
+    return len;
+}
+
+
+/*-------------------------------------------------------------------------*/
+/**
+  @brief      It exchanges the checkpoints with the partners of the ring.
+  @param      lfd             Checkpoint file, NULL to send from memory.
+  @param      hdr             Header of the checkpoint, if sent from memory.
+  @param      hsize           Size of the header.
+  @param      FTI_Data        Dataset array, if sent from memory.
+  @param      fs              Size of the checkpoint.
+  @param      maxFs           Size of the largest checkpoint of the group.
+  @param      pfd             Partner file, NULL if it could not be opened.
+  @return     integer         FTI_SCES if successful.
+
+  This function sends the checkpoint to the right process, block by block,
+  and writes the blocks received from the left process in the partner
+  file. Up to Pipeline_depth blocks are in flight: the reads of the next
+  blocks and the writes of the previous ones overlap the exchange of the
+  current one. Only the bytes of the checkpoint are sent, the size of
+  each received block is given by MPI. All the processes of the group
+  loop over the size of the largest checkpoint, and the exchange is
+  always completed, even if a file cannot be read or written, so that the
+  partner is not left waiting.
+
+ **/
+/*-------------------------------------------------------------------------*/
+int FTI_PtnerRing(FILE *lfd, char *hdr, unsigned long hsize, FTIT_dataset* FTI_Data,
+                  unsigned long fs, unsigned long maxFs, FILE *pfd) {
+    unsigned long bs = FTI_Conf.blockSize, pos, len;
+    int i, k, cnt, nb, depth = FTI_Conf.pipeDepth, res = FTI_SCES;
+    MPI_Request *req;
+    MPI_Status status;
+    char *sBuf, *rBuf;
+    sBuf = talloc(char, 2*depth*bs);
+    rBuf = sBuf + depth*bs;
+    req = talloc(MPI_Request, 2*depth);
+    nb = (maxFs + bs - 1) / bs;
+    for (i = 0; i < nb + depth; i++)
+    {
+        k = i % depth;
+        if (i >= depth)
+        { // Block i-depth is done, its slot is reused for block i
+            MPI_Wait(&req[2*k], MPI_STATUS_IGNORE);
+            MPI_Wait(&req[2*k+1], &status);
+            MPI_Get_count(&status, MPI_CHAR, &cnt);
+            if (pfd != NULL && cnt > 0 && fwrite(rBuf + k*bs, 1, cnt, pfd) != cnt)
+            {
+                FTI_Print("L2 partner file could not be written.", FTI_EROR);
+                pfd = NULL;
+                res = FTI_NSCS;
+            }
+        }
+        if (i < nb)
+        {
+            pos = (unsigned long) i * bs;
+            len = (pos < fs) ? ((fs - pos < bs) ? fs - pos : bs) : 0;
+            if (lfd == NULL)
+            {
+                FTI_ImageCopy(sBuf + k*bs, hdr, hsize, FTI_Data, fs, pos, bs);
+            } else if (len > 0 && fread(sBuf + k*bs, 1, len, lfd) != len)
+            {
+                FTI_Print("L2 checkpoint file could not be read.", FTI_EROR);
+                res = FTI_NSCS;
+            }
+            MPI_Irecv(rBuf + k*bs, bs, MPI_CHAR, FTI_Topo.left, FTI_Conf.tag, FTI_Exec.groupComm, &req[2*k+1]);
+            MPI_Isend(sBuf + k*bs, len, MPI_CHAR, FTI_Topo.right, FTI_Conf.tag, FTI_Exec.groupComm, &req[2*k]);
+        } else {
+            req[2*k] = MPI_REQUEST_NULL;
+            req[2*k+1] = MPI_REQUEST_NULL;
+        }
+    }
+    free(req);
+    free(sBuf);
+    return res;
+}
+
+
+/*-------------------------------------------------------------------------*/
+/**
+  @brief      It writes the checkpoint file and sends it to the partner.
+  @param      fn              Name of the checkpoint file.
+  @param      FTI_Data        Dataset array.
+  @return     integer         FTI_SCES if successful.
+
+  This function does the L2 partner copy without reading the checkpoint
+  file back. The local file is written by a thread with FTI_WriteFull,
+  while the calling thread sends the header and the datasets from memory
+  through FTI_PtnerRing.
+
+ **/
+/*-------------------------------------------------------------------------*/
+int FTI_WritePtner(char *fn, FTIT_dataset* FTI_Data) {
+    unsigned long hsize, fs, maxFs;
+    char *hdr, pfn[FTI_BUFS], str[FTI_BUFS];
+    FTIT_fileJob job;
+    int res = FTI_SCES;
+    FILE *pfd;
+    hdr = FTI_WriteStart(&job, fn, FTI_Data, &hsize, &fs, &maxFs);
+    if (hdr == NULL) res = FTI_NSCS;
+    sprintf(pfn,"%s/Ckpt%d-Pcof%d.fti", FTI_Conf.lTmpDir, FTI_Exec.ckptID, FTI_Topo.myRank);
+    pfd = fopen(pfn, "wb");
+    if (pfd == NULL)
+    {
+        FTI_Print("FTI failed to open L2 partner file.", FTI_EROR);
+        res = FTI_NSCS;
+    }
+    if (FTI_PtnerRing(NULL, hdr, hsize, FTI_Data, fs, maxFs, pfd) != FTI_SCES) res = FTI_NSCS;
+    if (pfd != NULL && fclose(pfd) != 0)
+    {
+        FTI_Print("L2 partner file could not be closed.", FTI_EROR);
+        res = FTI_NSCS;
+    }
+    if (FTI_WriteJoin(&job, hdr) != FTI_SCES) res = FTI_NSCS;
+    sprintf(str, "L2 partner copy of %lu bytes sent from memory.", fs);
+    FTI_Print(str, FTI_DBUG);
+    FTI_Exec.postDone = (res == FTI_SCES);
+    return res;
+}
+
+
+/*-------------------------------------------------------------------------*/
+/**
+  @brief      It gives the Reed-Solomon encoding matrix of a group.
+  @param      w               Word size of the Galois field.
+  @return     int*            Encoding matrix, kept for the next calls.
+
+  This function builds the Cauchy matrix used for L3, one row per
+  encoded file and one column per checkpoint file of the group. It only
+  depends on the group size and the word size, so it is built once.
+
+ **/
+/*-------------------------------------------------------------------------*/
+int* FTI_RSmatrix(int w) {
+    int i, j, *matrix;
+    if (FTI_RSmat[w] != NULL) return FTI_RSmat[w];
+    matrix = talloc(int, FTI_Topo.groupSize*FTI_Topo.groupSize);
+    for (i = 0; i < FTI_Topo.groupSize; i++) {
+        for (j = 0; j < FTI_Topo.groupSize; j++) {
+            matrix[i*FTI_Topo.groupSize+j] =
+                galois_single_divide(1, i ^ (FTI_Topo.groupSize + j), w);
+        }
+    }
+    FTI_RSmat[w] = matrix;
+    return matrix;
+}
+
+
+/*-------------------------------------------------------------------------*/
+/**
+  @brief      It prepares the L3 encoding context.
+  @param      w               Word size of the Galois field.
+  @return     integer         FTI_SCES if successful.
+
+  This function creates the Galois field tables of a word size and the
+  encoding matrix, and the bitmatrix with an L3 packet size for
+  L3_word_size. It is called at initialization for L3_word_size, and
+  before decoding for the word size of the checkpoint. The threads of
+  the pool multiply regions with the tables, they must exist before so
+  that the threads do not race to create them.
+
+ **/
+/*-------------------------------------------------------------------------*/
+int FTI_RSinit(int w) {
+    int res = 0;
+    switch (w) { // Tables of the region multiplications
+        case 8  : res = galois_create_mult_tables(8); break;
+        case 16 : res = galois_create_log_tables(16); break;
+        case 32 : res = galois_create_split_w8_tables(); break;
+    }
+    if (res < 0)
+    {
+        FTI_Print("Galois field tables could not be created.", FTI_WARN);
+        return FTI_NSCS;
+    }
+    FTI_RSmatrix(w);
+    if (FTI_Conf.l3PacketSize > 0 && w == FTI_Conf.l3WordSize) FTI_RSbitmatrix(w, NULL);
     return FTI_SCES;
 }
 
 
+/*-------------------------------------------------------------------------*/
+/**
+  @brief      It gives the Reed-Solomon bitmatrix of a group.
+  @param      w               Word size of the Galois field.
+  @param      schedule        Pointer to fill with the XOR schedule, or NULL.
+  @return     int*            Bitmatrix, kept for the next calls.
+
+  This function turns the Cauchy matrix of FTI_RSmatrix into a bitmatrix
+  of w rows and w columns per element, and the rows of the encoded file of
+  this process into a schedule of packet XORs. Both only depend on the
+  group and the word size, so they are built once and kept.
+
+ **/
+/*-------------------------------------------------------------------------*/
+int* FTI_RSbitmatrix(int w, int ***schedule) {
+    int gs = FTI_Topo.groupSize;
+    if (FTI_RSbits[w] == NULL)
+    {
+        FTI_RSbits[w] = jerasure_matrix_to_bitmatrix(gs, gs, w, FTI_RSmatrix(w));
+        FTI_RSsched[w] = jerasure_smart_bitmatrix_to_schedule(gs, 1, w, FTI_RSbits[w] + FTI_Topo.groupRank*gs*w*w);
+    }
+    if (schedule != NULL) *schedule = FTI_RSsched[w];
+    return FTI_RSbits[w];
+}
+
+
+/*-------------------------------------------------------------------------*/
+/**
+  @brief      It adds a checkpoint block to an encoded block.
+  @param      data            Checkpoint block.
+  @param      matVal          Factor of the checkpoint block.
+  @param      coding          Encoded block.
+  @param      bs              Size of the blocks.
+  @param      w               Word size of the Galois field.
+  @param      init            Pointer to the TRUE if coding is initialized.
+  @return     void
+
+  This function multiplies in the Galois field of w bits.
+
+ **/
+/*-------------------------------------------------------------------------*/
+void FTI_RSadd(char *data, int matVal, char *coding, int bs, int w, int *init) {
+    if (matVal == 0) return;
+    if (matVal == 1)
+    { // First copy or xor any data that does not need to be multiplied by a factor
+        if (*init == 0)
+        {
+            memcpy(coding, data, bs);
+        } else {
+            galois_region_xor(data, coding, coding, bs);
+        }
+    } else { // Then the data that needs to be multiplied by a factor
+        switch (w) {
+            case 8  : galois_w08_region_multiply(data, matVal, bs, coding, *init); break;
+            case 16 : galois_w16_region_multiply(data, matVal, bs, coding, *init); break;
+            case 32 : galois_w32_region_multiply(data, matVal, bs, coding, *init); break;
+        }
+    }
+    *init = 1;
+}
+
+
+/*-------------------------------------------------------------------------*/
+/**
+  @brief      It runs a slice of a region job of the L3 encoding.
+  @param      arg             Region job (FTIT_rsJob).
+  @param      task            Index of the slice.
+  @return     integer         FTI_SCES.
+
+  This function does the work of the job on the bytes of the slice only,
+  in all the blocks. It does not call MPI.
+
+ **/
+/*-------------------------------------------------------------------------*/
+int FTI_RSslice(void *arg, int task) {
+    FTIT_rsJob *job = (FTIT_rsJob *) arg;
+    int i, j, init, off = task*job->slice;
+    int len = (job->bs - off < job->slice) ? job->bs - off : job->slice;
+    char **ptrs;
+    if (job->schedule != NULL)
+    {
+        ptrs = talloc(char *, job->k + job->m);
+        for (i = 0; i < job->k; i++) ptrs[i] = job->data[i] + off;
+        for (i = 0; i < job->m; i++) ptrs[job->k+i] = job->coding[i] + off;
+        jerasure_schedule_encode(job->k, job->m, job->w, job->schedule, ptrs, ptrs + job->k, len, job->pk);
+        free(ptrs);
+        return FTI_SCES;
+    }
+    for (i = 0; i < job->m; i++)
+    {
+        init = job->add;
+        for (j = 0; j < job->k; j++)
+        {
+            FTI_RSadd(job->data[j] + off, job->row[i*job->k+j], job->coding[i] + off, len, job->w, &init);
+        }
+        if (!init) memset(job->coding[i] + off, 0, len);
+    }
+    return FTI_SCES;
+}
+
+
+/*-------------------------------------------------------------------------*/
+/**
+  @brief      It runs a region job of the L3 encoding on the thread pool.
+  @param      job             Region job, without the slice size.
+  @return     void
+
+  This function splits the blocks in L3_threads slices, whole packets of
+  w words or multiples of 1 KB, run by the thread pool. The slices being
+  independent, the result is the same as in one piece. While the pool
+  writes the checkpoint file, the job is run in one piece.
+
+ **/
+/*-------------------------------------------------------------------------*/
+void FTI_RSrun(FTIT_rsJob *job) {
+    int unit = (job->schedule != NULL) ? job->w*job->pk : 1024;
+    int units = (job->bs + unit - 1) / unit;
+    int nb = FTI_RSbusy ? 1 : FTI_Conf.l3Threads;
+    if (nb > units) nb = units;
+    job->slice = ((units + nb - 1) / nb) * unit;
+    FTI_PoolRun(FTI_RSslice, job, (job->bs + job->slice - 1) / job->slice);
+}
+
+
+/*-------------------------------------------------------------------------*/
+/**
+  @brief      It multiplies blocks by a row of factors and adds them.
+  @param      data            Checkpoint blocks.
+  @param      k               Number of checkpoint blocks.
+  @param      row             Factors of the checkpoint blocks.
+  @param      w               Word size of the Galois field.
+  @param      coding          Encoded block.
+  @param      add             TRUE to add to the encoded block.
+  @param      bs              Size of the blocks.
+  @return     void
+
+ **/
+/*-------------------------------------------------------------------------*/
+void FTI_RSmul(char **data, int k, int *row, int w, char *coding, int add, int bs) {
+    FTIT_rsJob job;
+    job.data = data; job.k = k; job.row = row; job.schedule = NULL;
+    job.w = w; job.pk = 0; job.coding = &coding; job.m = 1; job.add = add; job.bs = bs;
+    FTI_RSrun(&job);
+}
+
+
+/*-------------------------------------------------------------------------*/
+/**
+  @brief      It encodes blocks with an XOR schedule.
+  @param      data            Checkpoint blocks.
+  @param      k               Number of checkpoint blocks.
+  @param      schedule        XOR schedule of a k x m bitmatrix.
+  @param      w               Word size of the Galois field.
+  @param      pk              Packet size.
+  @param      coding          Encoded blocks.
+  @param      m               Number of encoded blocks.
+  @param      bs              Size of the blocks.
+  @return     void
+
+  This function encodes packets of pk bytes with XORs only, without any
+  multiplication in the Galois field.
+
+ **/
+/*-------------------------------------------------------------------------*/
+void FTI_RSxor(char **data, int k, int **schedule, int w, int pk, char **coding, int m, int bs) {
+    FTIT_rsJob job;
+    job.data = data; job.k = k; job.row = NULL; job.schedule = schedule;
+    job.w = w; job.pk = pk; job.coding = coding; job.m = m; job.add = 0; job.bs = bs;
+    FTI_RSrun(&job);
+}
+
+
+/*-------------------------------------------------------------------------*/
+/**
+  @brief      It encodes a block with a reduce-scatter in the group.
+  @param      data            Checkpoint block.
+  @param      parts           Buffer of groupSize blocks for the shares.
+  @param      coding          Encoded block.
+  @param      bs              Size of the blocks.
+  @return     void
+
+  This function multiplies the checkpoint block by the column of this
+  process in the encoding matrix, or its bitmatrix with an L3 packet
+  size, giving its share of each of the L3_parity encoded blocks of the
+  group. The shares are added (XOR) and scattered by MPI_Reduce_scatter,
+  so that each of the first L3_parity processes gets its encoded block
+  in log2(groupSize) steps with recursive halving. The addition being
+  associative, the encoded block is the same as with the ring.
+
+ **/
+/*-------------------------------------------------------------------------*/
+void FTI_RSreduce(char *data, char *parts, char *coding, int bs) {
+    int i, *matrix, *column, *bits, w = FTI_Conf.l3WordSize, cnt[32];
+    int gs = FTI_Topo.groupSize, me = FTI_Topo.groupRank, m = FTI_Conf.l3Parity;
+    char *ptrs[32];
+    matrix = FTI_RSmatrix(w);
+    if (FTI_Conf.l3PacketSize > 0)
+    {
+        if (FTI_RScolSched[w] == NULL)
+        { // Bitmatrix of our column only, one checkpoint file for all the encoded ones
+            column = talloc(int, m);
+            for (i = 0; i < m; i++) column[i] = matrix[i*gs+me];
+            bits = jerasure_matrix_to_bitmatrix(1, m, w, column);
+            FTI_RScolSched[w] = jerasure_smart_bitmatrix_to_schedule(1, m, w, bits);
+            free(bits);
+            free(column);
+        }
+        for (i = 0; i < m; i++) ptrs[i] = parts + i*bs;
+        FTI_RSxor(&data, 1, FTI_RScolSched[w], w, FTI_Conf.l3PacketSize, ptrs, m, bs);
+    } else {
+        for (i = 0; i < m; i++) FTI_RSmul(&data, 1, &matrix[i*gs+me], w, parts + i*bs, 0, bs);
+    }
+    for (i = 0; i < gs; i++) cnt[i] = (i < m) ? bs : 0; // Only the first ranks get an encoded block
+    MPI_Reduce_scatter(parts, coding, cnt, MPI_BYTE, MPI_BXOR, FTI_Exec.groupComm);
+}
+
+
+/*-------------------------------------------------------------------------*/
+/**
+  @brief      It writes the checkpoint file and encodes it in the group.
+  @param      fn              Name of the checkpoint file.
+  @param      FTI_Data        Dataset array.
+  @return     integer         FTI_SCES if successful.
+
+  This function does the L3 encoding without reading the checkpoint file
+  back. The local file is written by a thread with FTI_WriteFull, while
+  the calling thread takes the blocks of the checkpoint from memory. Each
+  block is sent to all the other processes of the group at once, and the
+  blocks received are multiplied and added to the encoded block in the
+  order they arrive, or all together by FTI_RSxor with an L3 packet size.
+  The exchange of the next block is started before the current one is
+  encoded and written to the encoded file, so that disk, network and
+  computation overlap. The encoding is spread over L3_threads, unless the
+  thread pool writes the file. Only the first L3_parity processes of the
+  group receive the blocks and write an encoded file. The blocks are
+  zero-padded to the size of the largest checkpoint of the group, giving
+  the same encoded file as FTI_RSenc. The exchange is always completed,
+  even if a file cannot be written, so that the group is not left
+  waiting.
+
+ **/
+/*-------------------------------------------------------------------------*/
+int FTI_WriteRSenc(char *fn, FTIT_dataset* FTI_Data) {
+    unsigned long bs = FTI_Conf.blockSize, hsize, fs, maxFs, ps;
+    int i, j, k, b, nb, res = FTI_SCES, gs = FTI_Topo.groupSize, me = FTI_Topo.groupRank;
+    int w = FTI_Conf.l3WordSize, **schedule, cod = (me < FTI_Conf.l3Parity);
+    char *hdr, *sBuf, *rBuf, *coding, **ptrs, efn[FTI_BUFS], str[FTI_BUFS];
+    MPI_Request *req;
+    FTIT_fileJob job;
+    int *matrix;
+    FILE *efd;
+    FTI_RSbusy = (FTI_Conf.ioThreads > 1); // The pool writes the file
+    hdr = FTI_WriteStart(&job, fn, FTI_Data, &hsize, &fs, &maxFs);
+    if (hdr == NULL) res = FTI_NSCS;
+    sprintf(efn,"%s/Ckpt%d-RSed%d.fti", FTI_Conf.lTmpDir, FTI_Exec.ckptID, FTI_Topo.myRank);
+    efd = cod ? fopen(efn, "wb") : NULL;
+    if (cod && efd == NULL)
+    {
+        FTI_Print("FTI failed to open encoded ckpt. file.", FTI_EROR);
+        res = FTI_NSCS;
+    }
+    ps = ((maxFs + bs - 1) / bs) * bs;
+    nb = ps / bs;
+    matrix = FTI_RSmatrix(w);
+    sBuf = talloc(char, 2*bs);
+    rBuf = talloc(char, 2*gs*bs);
+    coding = talloc(char, bs);
+    ptrs = talloc(char *, gs);
+    req = talloc(MPI_Request, 4*gs);
+    for (b = 0; b <= nb; b++)
+    { // Block b is exchanged while block b-1 is encoded and written
+        if (b < nb)
+        {
+            k = b % 2;
+            FTI_ImageCopy(sBuf + k*bs, hdr, hsize, FTI_Data, fs, (unsigned long) b * bs, bs);
+            for (j = 0; j < gs; j++)
+            {
+                req[k*2*gs+j] = MPI_REQUEST_NULL;
+                req[k*2*gs+gs+j] = MPI_REQUEST_NULL;
+                if (j == me) continue;
+                if (cod) MPI_Irecv(rBuf + (k*gs+j)*bs, bs, MPI_CHAR, j, FTI_Conf.tag, FTI_Exec.groupComm, &req[k*2*gs+j]);
+                if (j < FTI_Conf.l3Parity) MPI_Isend(sBuf + k*bs, bs, MPI_CHAR, j, FTI_Conf.tag, FTI_Exec.groupComm, &req[k*2*gs+gs+j]);
+            }
+        }
+        if (b > 0)
+        {
+            k = (b - 1) % 2;
+            if (!cod)
+            { // No encoded file, the block only had to be sent
+            } else if (FTI_Conf.l3PacketSize > 0)
+            { // The XOR schedule needs all the blocks at once
+                MPI_Waitall(gs, &req[k*2*gs], MPI_STATUSES_IGNORE);
+                for (j = 0; j < gs; j++) ptrs[j] = (j == me) ? sBuf + k*bs : rBuf + (k*gs+j)*bs;
+                FTI_RSbitmatrix(w, &schedule);
+                FTI_RSxor(ptrs, gs, schedule, w, FTI_Conf.l3PacketSize, &coding, 1, bs);
+            } else {
+                ptrs[0] = sBuf + k*bs;
+                FTI_RSmul(ptrs, 1, &matrix[me*gs+me], w, coding, 0, bs);
+                for (i = 1; i < gs; i++)
+                { // Blocks of the others, as they arrive
+                    MPI_Waitany(gs, &req[k*2*gs], &j, MPI_STATUS_IGNORE);
+                    ptrs[0] = rBuf + (k*gs+j)*bs;
+                    FTI_RSmul(ptrs, 1, &matrix[me*gs+j], w, coding, 1, bs);
+                }
+            }
+            MPI_Waitall(gs, &req[k*2*gs+gs], MPI_STATUSES_IGNORE);
+            if (efd != NULL && fwrite(coding, sizeof(char), bs, efd) != bs)
+            {
+                FTI_Print("Encoded ckpt. file could not be written.", FTI_EROR);
+                fclose(efd);
+                efd = NULL;
+                res = FTI_NSCS;
+            }
+        }
+    }
+    free(req);
+    free(ptrs);
+    free(coding);
+    free(rBuf);
+    free(sBuf);
+    if (efd != NULL && fclose(efd) != 0)
+    {
+        FTI_Print("Encoded ckpt. file could not be closed.", FTI_EROR);
+        res = FTI_NSCS;
+    }
+    if (FTI_WriteJoin(&job, hdr) != FTI_SCES) res = FTI_NSCS;
+    FTI_RSbusy = 0;
+    sprintf(str, "L3 encoding of %lu bytes done from memory.", fs);
+    FTI_Print(str, FTI_DBUG);
+    FTI_Exec.postDone = (res == FTI_SCES);
+    return res;
+}
+
+
 /*-------------------------------------------------------------------------*/
 /**
   @brief      It performs RS encoding with the ckpt. files in to the group.
@@ -99,23 +760,40 @@ int FTI_Ptner(int group) {
   @return     integer         FTI_SCES if successful.
 
   This function performs the Reed-Solomon encoding for a given group. The
-  checkpoint files are padded to the maximum size of the largest checkpoint
-  file in the group +- the extra space to be a multiple of block size.
+  checkpoint files are padded with zeros to the maximum size of the largest
+  checkpoint file in the group +- the extra space to be a multiple of block
+  size. The encoded file keeps this padded size, as the last block may end
+  in the middle of a word. The blocks go around the ring of the group,
+  or are encoded by FTI_RSreduce with L3_reduce_scatter or when only the
+  first L3_parity processes keep an encoded file. With an L3
+  packet size, the ring keeps all the blocks of the group and encodes
+  them together by FTI_RSxor. The blocks are encoded by the L3_threads of
+  the thread pool, while the exchange is done by the calling thread. If
+  the encoding was already done from memory by FTI_WriteRSenc, there is
+  nothing left to do.
 
  **/
 /*-------------------------------------------------------------------------*/
 int FTI_RSenc(int group) {
-    char *myData, *data, *coding, lfn[FTI_BUFS], efn[FTI_BUFS], str[FTI_BUFS];
-    int *matrix, cnt, i, j, init, src, offset, dest, matVal, res, bs = FTI_Conf.blockSize;
+    char *myData, *data, *coding, *blk, **ptrs, lfn[FTI_BUFS], efn[FTI_BUFS], str[FTI_BUFS];
+    int *matrix, **schedule, cnt, i, src, offset, dest, res, bs = FTI_Conf.blockSize;
+    int xor = (FTI_Conf.l3PacketSize > 0), w = FTI_Conf.l3WordSize;
+    int red = (FTI_Conf.l3Reduce || FTI_Conf.l3Parity < FTI_Topo.groupSize);
+    int cod = (FTI_Topo.groupRank < FTI_Conf.l3Parity);
     unsigned long maxFs, fs, ps, pos = 0;
     MPI_Request reqSend, reqRecv;
     MPI_Status status;
-    int remBsize = bs;
+    int remBsize;
     FILE *lfd, *efd;
 
     FTI_Print("Starting checkpoint post-processing L3", FTI_DBUG);
     res = FTI_Try(FTI_GetMeta(&fs, &maxFs, group, 0), "obtain metadata.");
     if (res != FTI_SCES) return FTI_NSCS;
+    if (FTI_Exec.postDone)
+    {
+        FTI_Print("L3 encoding already done from memory.", FTI_DBUG);
+        return FTI_SCES;
+    }
     ps = ((maxFs/bs))*bs;
     if (ps < maxFs) ps = ps + bs;
 
@@ -128,13 +806,13 @@ int FTI_RSenc(int group) {
     if (res != FTI_SCES) return FTI_NSCS;
 
     lfd = fopen(lfn, "rb");
-    efd = fopen(efn, "wb");
+    efd = cod ? fopen(efn, "wb") : NULL;
     if (lfd == NULL)
     {
         FTI_Print("FTI failed to open L3 checkpoint file.", FTI_EROR);
         return FTI_NSCS;
     }
-    if (efd == NULL)
+    if (cod && efd == NULL)
     {
         FTI_Print("FTI failed to open encoded ckpt. file.", FTI_EROR);
         return FTI_NSCS;
@@ -142,77 +820,170 @@ int FTI_RSenc(int group) {
 
     myData = talloc(char, bs);
     coding = talloc(char, bs);
-    data   = talloc(char, 2*bs);
-    matrix = talloc(int, FTI_Topo.groupSize*FTI_Topo.groupSize);
-
-    for (i = 0; i < FTI_Topo.groupSize; i++) {
-        for (j = 0; j < FTI_Topo.groupSize; j++) {
-            matrix[i*FTI_Topo.groupSize+j] =
-                galois_single_divide(1, i ^ (FTI_Topo.groupSize + j), FTI_Conf.l3WordSize);
-        }
-    }
+    data   = talloc(char, ((xor || red) ? FTI_Topo.groupSize : 2)*bs);
+    ptrs   = talloc(char *, FTI_Topo.groupSize);
+    matrix = FTI_RSmatrix(w);
+    for (i = 0; i < FTI_Topo.groupSize; i++) ptrs[i] = &(data[i*bs]);
 
     while(pos < ps)
     { // For each block
-        if ((fs-pos) < bs) remBsize = fs-pos;
+        remBsize = (pos < fs) ? ((fs-pos < bs) ? fs-pos : bs) : 0;
         fread(myData, sizeof(char), remBsize, lfd); // Reading checkpoint files
-        dest = FTI_Topo.groupRank;
-        i = FTI_Topo.groupRank;
-        offset = 0;
-        init = 0;
-        cnt = 0;
-        while(cnt < FTI_Topo.groupSize)
-        { // For each encoding
-            if (cnt == 0)
-            {
-                memcpy(&(data[offset*bs]), myData, sizeof(char)*bs);
-            } else {
-                MPI_Wait(&reqSend, &status);
-                MPI_Wait(&reqRecv, &status);
-            }
-            if (cnt != FTI_Topo.groupSize-1)
-            { // At every loop *but* the last one we send the data
-                dest = (dest+FTI_Topo.groupSize-1)%FTI_Topo.groupSize;
-                src = (i+1)%FTI_Topo.groupSize;
-                MPI_Isend(myData, bs, MPI_CHAR, dest, FTI_Conf.tag, FTI_Exec.groupComm, &reqSend);
-                MPI_Irecv(&(data[(1-offset)*bs]), bs, MPI_CHAR, src, FTI_Conf.tag, FTI_Exec.groupComm, &reqRecv);
-            }
-            matVal = matrix[FTI_Topo.groupRank*FTI_Topo.groupSize+i];
-            if (matVal == 1)
-            { // First copy or xor any data that does not need to be multiplied by a factor
-                if (init == 0)
+        memset(myData+remBsize, 0, bs-remBsize); // Zero padding, as when decoding
+        if (red)
+        { // Shares of all the encoded blocks, added in the group
+            FTI_RSreduce(myData, data, coding, bs);
+        } else {
+            dest = FTI_Topo.groupRank;
+            i = FTI_Topo.groupRank;
+            offset = 0;
+            cnt = 0;
+            while(cnt < FTI_Topo.groupSize)
+            { // For each encoding
+                if (cnt == 0)
                 {
-                    memcpy(coding, &(data[offset*bs]), bs);
-                    init = 1;
+                    memcpy(&(data[(xor ? i : offset)*bs]), myData, sizeof(char)*bs);
                 } else {
-                    galois_region_xor(&(data[offset*bs]), coding, coding, bs);
+                    MPI_Wait(&reqSend, &status);
+                    MPI_Wait(&reqRecv, &status);
+                }
+                if (cnt != FTI_Topo.groupSize-1)
+                { // At every loop *but* the last one we send the data
+                    dest = (dest+FTI_Topo.groupSize-1)%FTI_Topo.groupSize;
+                    src = (i+1)%FTI_Topo.groupSize;
+                    MPI_Isend(myData, bs, MPI_CHAR, dest, FTI_Conf.tag, FTI_Exec.groupComm, &reqSend);
+                    MPI_Irecv(&(data[(xor ? src : 1-offset)*bs]), bs, MPI_CHAR, src, FTI_Conf.tag, FTI_Exec.groupComm, &reqRecv);
+                }
+                if (!xor)
+                {
+                    blk = &(data[offset*bs]);
+                    FTI_RSmul(&blk, 1, &matrix[FTI_Topo.groupRank*FTI_Topo.groupSize+i], w, coding, cnt > 0, bs);
                 }
+                i = (i+1)%FTI_Topo.groupSize;
+                offset = 1 - offset;
+                cnt++;
             }
-            if (matVal != 0 && matVal != 1)
-            { // Then the data that needs to be multiplied by a factor
-                galois_w16_region_multiply(&(data[offset*bs]), matVal, bs, coding, init);
-                init = 1;
+            if (xor)
+            { // All the blocks of the group received
+                FTI_RSbitmatrix(w, &schedule);
+                FTI_RSxor(ptrs, FTI_Topo.groupSize, schedule, w, FTI_Conf.l3PacketSize, &coding, 1, bs);
             }
-            i = (i+1)%FTI_Topo.groupSize;
-            offset = 1 - offset;
-            cnt++;
         }
-        fwrite(coding, sizeof(char), remBsize, efd); // Writting encoded checkpoints
+        if (cod) fwrite(coding, sizeof(char), bs, efd); // Writting encoded checkpoints
         pos = pos + bs; // Next block
     }
 
     free(data);
-    free(matrix);
+    free(ptrs);
     free(coding);
     free(myData);
 
     fclose(lfd);
-    fclose(efd);
+    if (cod) fclose(efd);
 
     return FTI_SCES;
 }
 
 
+/*-------------------------------------------------------------------------*/
+/**
+  @brief      It reads a row of blocks for the L3 XOR parity.
+  @param      fd              Checkpoint file, read in order.
+  @param      fs              Size of the checkpoint file.
+  @param      data            Buffer of groupSize blocks to fill.
+  @return     void
+
+  This function reads the next groupSize-1 blocks of the checkpoint file,
+  zero-padded past its end. The j-th block of the row goes to the slot of
+  the process groupRank+1+j of the group, so that the slot of this process
+  is left untouched and no process keeps the parity of its own blocks.
+
+ **/
+/*-------------------------------------------------------------------------*/
+void FTI_XORrow(FILE *fd, unsigned long fs, char *data) {
+    unsigned long bs = FTI_Conf.blockSize, pos, len;
+    int j, gs = FTI_Topo.groupSize;
+    char *blk;
+    for (j = 0; j < gs-1; j++)
+    {
+        blk = data + ((FTI_Topo.groupRank+1+j) % gs)*bs;
+        pos = ftell(fd);
+        len = (pos < fs) ? ((fs-pos < bs) ? fs-pos : bs) : 0;
+        len = fread(blk, sizeof(char), len, fd);
+        memset(blk+len, 0, bs-len);
+    }
+}
+
+
+/*-------------------------------------------------------------------------*/
+/**
+  @brief      It performs the XOR parity of the ckpt. files of the group.
+  @param      group           The group ID.
+  @return     integer         FTI_SCES if successful.
+
+  This function is the L3 encoding with L3_xor_parity, a single parity
+  spread over the group as in RAID-5. The padded checkpoint file is read
+  in rows of groupSize-1 blocks by FTI_XORrow, one block for each other
+  process. The rows are added (XOR) and scattered by
+  MPI_Reduce_scatter_block, so that each process gets the parity of the
+  blocks sent to it, in a file of 1/(groupSize-1) of the largest
+  checkpoint of the group. One lost process per group can be recovered by
+  FTI_XORdec.
+
+ **/
+/*-------------------------------------------------------------------------*/
+int FTI_XORenc(int group) {
+    char *data, *parity, lfn[FTI_BUFS], efn[FTI_BUFS];
+    int i, res = FTI_SCES, bs = FTI_Conf.blockSize, gs = FTI_Topo.groupSize;
+    unsigned long maxFs, fs, rows, t;
+    FILE *lfd, *efd;
+
+    FTI_Print("Starting checkpoint post-processing L3 (XOR parity)", FTI_DBUG);
+    res = FTI_Try(FTI_GetMeta(&fs, &maxFs, group, 0), "obtain metadata.");
+    if (res != FTI_SCES) return FTI_NSCS;
+    rows = ((maxFs + bs - 1) / bs + gs - 2) / (gs - 1);
+
+    sscanf(FTI_Exec.ckptFile,"Ckpt%d-Rank%d.fti", &FTI_Exec.ckptID, &i);
+    sprintf(lfn,"%s/%s",FTI_Conf.lTmpDir, FTI_Exec.ckptFile);
+    sprintf(efn,"%s/Ckpt%d-Pxor%d.fti", FTI_Conf.lTmpDir, FTI_Exec.ckptID, i);
+    lfd = fopen(lfn, "rb");
+    if (lfd == NULL)
+    {
+        FTI_Print("FTI failed to open L3 checkpoint file.", FTI_EROR);
+        return FTI_NSCS;
+    }
+    efd = fopen(efn, "wb");
+    if (efd == NULL)
+    {
+        FTI_Print("FTI failed to open parity ckpt. file.", FTI_EROR);
+        fclose(lfd);
+        return FTI_NSCS;
+    }
+
+    data = talloc(char, gs*bs);
+    parity = talloc(char, bs);
+    memset(data + FTI_Topo.groupRank*bs, 0, bs); // Nothing for itself
+    for (t = 0; t < rows; t++)
+    { // Rows are still exchanged after an error, the group is not left waiting
+        FTI_XORrow(lfd, fs, data);
+        MPI_Reduce_scatter_block(data, parity, bs, MPI_BYTE, MPI_BXOR, FTI_Exec.groupComm);
+        if (res == FTI_SCES && fwrite(parity, sizeof(char), bs, efd) != bs)
+        {
+            FTI_Print("Parity ckpt. file could not be written.", FTI_EROR);
+            res = FTI_NSCS;
+        }
+    }
+
+    free(data);
+    free(parity);
+
+    fclose(lfd);
+    if (fclose(efd) != 0) res = FTI_NSCS;
+
+    return res;
+}
+
+
 /*-------------------------------------------------------------------------*/
 /**
   @brief      It flushes the local ckpt. files in to the PFS.
@@ -220,7 +991,9 @@ int FTI_RSenc(int group) {
   @param      level           The level from which ckpt. files are flushed.
   @return     integer         FTI_SCES if successful.
 
-  This function flushes the local checkpoint files in to the PFS.
+  This function flushes the local checkpoint files in to the PFS. With
+  direct I/O the copy is done by FTI_CopyDirect, through aligned buffers.
+  Incremental checkpoints are flattened in to a full checkpoint file.
 
  **/
 /*-------------------------------------------------------------------------*/
@@ -254,6 +1027,16 @@ int FTI_Flush(int group, int level) {
         FTI_Print("L4 cannot access the checkpoint file.", FTI_EROR);
         return FTI_NSCS;
     }
+    if (FTI_Exec.incChain[0] != '\0')
+    { // Rebuild the full checkpoint from the incremental chain
+        free(blBuf1);
+        return FTI_IncFlatten(lfn, gfn);
+    }
+    if (FTI_Conf.directIO)
+    { // Copy bypassing the page cache
+        free(blBuf1);
+        return FTI_CopyDirect(lfn, gfn, fs);
+    }
     lfd = fopen(lfn, "rb");
     if (lfd == NULL)
     {
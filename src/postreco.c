@@ -9,82 +9,244 @@
 #include "fti.h"
 
 
+/** Our part of the decoding of an erasure pattern, kept for later.      */
+typedef struct FTIT_rsDecoder {
+    unsigned long long      mask;       /** Erased ckpt. and encoded files.*/
+    int                     w;          /** Word size of the field.        */
+    int                     pk;         /** Packet size, 0 if unused.      */
+    int                     m;          /** Number of encoded files.       */
+    int                     nbSrc;      /** Our files used for decoding.   */
+    int                     srcId[2];   /** Their IDs, encoded ones + k.   */
+    int                     *decRows;   /** Our columns of the inverse.    */
+    int                     **decSched; /** XOR schedule of decRows.       */
+    int                     *encRows;   /** Our column for lost encodings. */
+    int                     **encSched; /** XOR schedule of encRows.       */
+    struct FTIT_rsDecoder   *next;      /** Next erasure pattern.          */
+} FTIT_rsDecoder;
+
+/** Erasure patterns already decoded.                                      */
+static FTIT_rsDecoder      *FTI_RSdecoders = NULL;
+
+
+/*-------------------------------------------------------------------------*/
+/**
+    @brief      It gives our part of the decoding of an erasure pattern.
+    @param      erased          Erased ckpt. files, then encoded files.
+    @param      dm_ids          Files used for the decoding, in order.
+    @return     FTIT_rsDecoder* Decoding matrix, NULL if not invertible.
+
+    This function inverts the rows of the encoding matrix of the files
+    left, in the Galois field and with the packet size recorded in the
+    metadata, or the bitmatrix with a packet size. Only the columns of the
+    files of this process are kept, for the lost checkpoint files, and its
+    column of the encoding matrix for the lost encoded files. With a packet
+    size they are turned in to XOR schedules. The result only depends on
+    the erasure pattern and the encoding parameters of the metadata, so it
+    is kept for the next recoveries of the same files.
+
+ **/
+/*-------------------------------------------------------------------------*/
+FTIT_rsDecoder* FTI_RSdecoder(int *erased, int *dm_ids) {
+    int *matrix, *bitmatrix, *tmpmat, *decMatrix, *bits, i, j, a, b, r, c, n, k = FTI_Topo.groupSize;
+    int w = FTI_Exec.l3WordSize, pk = FTI_Exec.l3PacketSize, m = FTI_Exec.l3Parity, me = FTI_Topo.groupRank, nd = 0, nc = 0;
+    int lost[64], col[2];
+    unsigned long long mask = 0;
+    FTIT_rsDecoder *dec;
+    for (i = 0; i < 2*k; i++) if (erased[i]) mask |= 1ULL << i;
+    for (dec = FTI_RSdecoders; dec != NULL; dec = dec->next)
+    {
+        if (dec->mask == mask && dec->w == w && dec->pk == pk && dec->m == m) return dec;
+    }
+    n = (pk > 0) ? k*w : k; // Rows of the matrix to invert
+    tmpmat = talloc(int, n*n); decMatrix = talloc(int, n*n);
+    matrix = FTI_RSmatrix(w);
+    bitmatrix = (pk > 0) ? FTI_RSbitmatrix(w, NULL) : NULL;
+    for (i = 0; i < k; i++) { // Building the matrix
+        if (dm_ids[i] < k && pk > 0) {
+            for (j = 0; j < w*n; j++) tmpmat[i*w*n+j] = 0;
+            for (j = 0; j < w; j++) tmpmat[(i*w+j)*n+dm_ids[i]*w+j] = 1;
+        } else if (pk > 0) {
+            memcpy(&tmpmat[i*w*n], &bitmatrix[(dm_ids[i]-k)*w*n], w*n*sizeof(int));
+        } else if (dm_ids[i] < k) {
+            for (j = 0; j < k; j++) tmpmat[i*k+j] = 0;
+            tmpmat[i*k+dm_ids[i]] = 1;
+        } else for (j = 0; j < k; j++) { tmpmat[i*k+j] = matrix[(dm_ids[i]-k)*k+j]; }
+    } // Inversing the matrix
+    if (((pk > 0) ? jerasure_invert_bitmatrix(tmpmat, decMatrix, n) : jerasure_invert_matrix(tmpmat, decMatrix, n, w)) < 0)
+        { free(tmpmat); free(decMatrix); return NULL; }
+    free(tmpmat);
+    dec = talloc(FTIT_rsDecoder, 1);
+    dec->mask = mask; dec->w = w; dec->pk = pk; dec->m = m; dec->nbSrc = 0;
+    for (i = 0; i < k; i++) { // Our files among the ones left
+        if (dm_ids[i] == me || dm_ids[i] == me+k) { col[dec->nbSrc] = i; dec->srcId[dec->nbSrc++] = dm_ids[i]; }
+    }
+    for (i = 0; i < k; i++) if (erased[i]) lost[nd++] = i;
+    for (i = 0; i < FTI_Exec.l3Parity; i++) if (erased[i+k]) lost[nd+nc++] = i;
+    dec->decRows = talloc(int, (nd*dec->nbSrc*w*w)+1); dec->encRows = talloc(int, (nc*w*w)+1);
+    for (a = 0; a < nd; a++) for (r = 0; r < n/k; r++) for (b = 0; b < dec->nbSrc; b++) for (c = 0; c < n/k; c++)
+        dec->decRows[(a*(n/k)+r)*dec->nbSrc*(n/k)+b*(n/k)+c] = decMatrix[(lost[a]*(n/k)+r)*n+col[b]*(n/k)+c];
+    for (a = 0; a < nc; a++) for (r = 0; r < n/k; r++) for (c = 0; c < n/k; c++)
+        dec->encRows[(a*(n/k)+r)*(n/k)+c] = (pk > 0) ? bitmatrix[(lost[nd+a]*w+r)*n+me*w+c] : matrix[lost[nd+a]*k+me];
+    dec->decSched = NULL; dec->encSched = NULL;
+    if (pk > 0) { // Scheduled once, the bits are not needed anymore
+        bits = dec->decRows; dec->decRows = NULL;
+        if (nd > 0 && dec->nbSrc > 0) dec->decSched = jerasure_smart_bitmatrix_to_schedule(dec->nbSrc, nd, w, bits);
+        free(bits);
+        bits = dec->encRows; dec->encRows = NULL;
+        if (nc > 0) dec->encSched = jerasure_smart_bitmatrix_to_schedule(1, nc, w, bits);
+        free(bits);
+    }
+    free(decMatrix);
+    dec->next = FTI_RSdecoders;
+    FTI_RSdecoders = dec;
+    return dec;
+}
+
+
 /*-------------------------------------------------------------------------*/
 /**
     @brief      Recover a set of ckpt. files using RS decoding.
     @return     integer         FTI_SCES if successful.
 
     This function tries to recover the L3 ckpt. files missing using the
-    RS decoding.
+    RS decoding, in the Galois field recorded in the metadata. Checkpoints
+    encoded with a packet size are decoded with XOR schedules. Each process
+    multiplies its own files by its columns of the decoding matrix given
+    by FTI_RSdecoder, and the shares are added (XOR) and scattered to the
+    processes that lost their checkpoint file by MPI_Reduce_scatter, as
+    for the encoding by FTI_RSreduce. The lost encoded files are then
+    encoded again the same way, from the checkpoint files. Processes with
+    nothing lost only send their shares, so the recovery costs about as
+    much as the encoding. The shares are computed by the L3_threads of
+    the thread pool. The ranks beyond the parity of the checkpoint have
+    no encoded file to rebuild.
 
  **/
 /*-------------------------------------------------------------------------*/
 int FTI_Decode(int fs, int maxFs, int *erased) {
-    int *matrix, *decMatrix, *dm_ids, *tmpmat, i, j, k, m, ps, bs, pos = 0;
-    char **coding, **data, *dataTmp, fn[FTI_BUFS], efn[FTI_BUFS], str[FTI_BUFS];
+    int *dm_ids, i, j, k, nd = 0, nc = 0, ps, bs, pos = 0, cntD[32], cntC[32];
+    int w = FTI_Exec.l3WordSize, pk = FTI_Exec.l3PacketSize, m = FTI_Exec.l3Parity, me = FTI_Topo.groupRank;
+    int cod = (me < FTI_Exec.l3Parity); // TRUE if we have an encoded file
+    char *data, *coding, *parts, *srcs[2], *outs[32], fn[FTI_BUFS], efn[FTI_BUFS];
+    FTIT_rsDecoder *dec;
     FILE *fd, *efd;
-    bs = FTI_Conf.blockSize; k = FTI_Topo.groupSize; m = k;
+    bs = FTI_Conf.blockSize; k = FTI_Topo.groupSize;
+    if (pk > 0 && bs % (w*pk) != 0)
+        { FTI_Print("L3 packet size of the checkpoint does not fit the block size.", FTI_WARN); return FTI_NSCS; }
     ps = ((maxFs/FTI_Conf.blockSize))*FTI_Conf.blockSize;
     if (ps < maxFs) ps = ps + FTI_Conf.blockSize; // Calculating padding size
     if (access(FTI_Ckpt[3].dir, F_OK) != 0) mkdir(FTI_Ckpt[3].dir, 0777);
     sscanf(FTI_Exec.ckptFile,"Ckpt%d-Rank%d.fti", &FTI_Exec.ckptID, &i);
     sprintf(fn,"%s/%s",FTI_Ckpt[3].dir, FTI_Exec.ckptFile);
     sprintf(efn,"%s/Ckpt%d-RSed%d.fti", FTI_Ckpt[3].dir, FTI_Exec.ckptID, i);
-    data = talloc(char *, k); coding = talloc(char *, m); dataTmp = talloc(char, FTI_Conf.blockSize*k);
-    dm_ids = talloc(int, k); decMatrix = talloc(int, k*k); tmpmat = talloc(int, k*k); matrix =  talloc(int, k*k);
-    for (i = 0; i < FTI_Topo.groupSize; i++) {
-        for (j = 0; j < FTI_Topo.groupSize; j++) {
-            matrix[i*FTI_Topo.groupSize+j] =
-                galois_single_divide(1, i ^ (FTI_Topo.groupSize + j), FTI_Conf.l3WordSize);
-        }
-    }
-    for (i = 0; i < m; i++) {
-        coding[i] = talloc(char, FTI_Conf.blockSize);
-        data[i] = talloc(char, FTI_Conf.blockSize);
+    for (i = 0; i < k; i++) { // Who gets a decoded or re-encoded block
+        cntD[i] = erased[i] ? bs : 0; nd += erased[i] ? 1 : 0;
+        cntC[i] = (i < FTI_Exec.l3Parity && erased[i+k]) ? bs : 0; nc += cntC[i] ? 1 : 0;
     }
+    if (FTI_RSinit(w) != FTI_SCES) return FTI_NSCS; // Tables of the field of the checkpoint
+    dm_ids = talloc(int, k);
     j = 0; for (i = 0; j < k; i++) { if (erased[i] == 0) {dm_ids[j] = i; j++;} }
-    for (i = 0; i < k; i++) { // Building the matrix
-        if (dm_ids[i] < k) {
-            for (j = 0; j < k; j++) tmpmat[i*k+j] = 0;
-            tmpmat[i*k+dm_ids[i]] = 1;
-        } else for (j = 0; j < k; j++) { tmpmat[i*k+j] = matrix[(dm_ids[i]-k)*k+j]; }
-    } // Inversing the matrix
-    if (jerasure_invert_matrix(tmpmat, decMatrix, k, FTI_Conf.l3WordSize) < 0)
-        { FTI_Print("Error inversing matrix", FTI_DBUG); return FTI_NSCS; }
-    if(erased[FTI_Topo.groupRank] == 0) { // Resize and open files
+    dec = FTI_RSdecoder(erased, dm_ids);
+    free(dm_ids);
+    if (dec == NULL) { FTI_Print("Error inversing matrix", FTI_DBUG); return FTI_NSCS; }
+    if(erased[me] == 0) { // Resize and open files
         if (truncate(fn,ps) == -1) { FTI_Print("Error with truncate on checkpoint file", FTI_DBUG); return FTI_NSCS; }
-        fd = fopen(fn, "rb"); efd = fopen(efn, "rb");
-    } else { fd = fopen(fn, "wb"); efd = fopen(efn, "wb"); }
+        fd = fopen(fn, "rb");
+    } else fd = fopen(fn, "wb");
+    if (!cod) efd = NULL;
+    else if(erased[me + k] == 0) {
+        if (truncate(efn,ps) == -1) { FTI_Print("Error with truncate on encoded ckpt. file", FTI_DBUG); return FTI_NSCS; }
+        efd = fopen(efn, "rb");
+    } else efd = fopen(efn, "wb");
     if (fd == NULL) { FTI_Print("R3 cannot open checkpoint file.", FTI_DBUG); return FTI_NSCS; }
-    if (efd == NULL) { FTI_Print("R3 cannot open encoded ckpt. file.", FTI_DBUG); return FTI_NSCS; }
+    if (cod && efd == NULL) { FTI_Print("R3 cannot open encoded ckpt. file.", FTI_DBUG); return FTI_NSCS; }
+    data = talloc(char, bs); coding = talloc(char, bs); parts = talloc(char, ((nd > nc) ? nd : nc)*bs);
+    for (i = 0; i < dec->nbSrc; i++) srcs[i] = (dec->srcId[i] < k) ? data : coding;
     while(pos < ps) { // Main loop, block by block
-        if(erased[FTI_Topo.groupRank] == 0) { // Reading the data
-            fread(data[FTI_Topo.groupRank]+0, sizeof(char), bs, fd);
-            fread(coding[FTI_Topo.groupRank]+0, sizeof(char), bs, efd);
-        } else { bzero(data[FTI_Topo.groupRank], bs); bzero(coding[FTI_Topo.groupRank], bs); } // Erasure found
-        MPI_Allgather(data[FTI_Topo.groupRank]+0, bs, MPI_CHAR, dataTmp, bs, MPI_CHAR, FTI_Exec.groupComm);
-        for (i = 0; i < k; i++) memcpy(data[i]+0, &(dataTmp[i*bs]), sizeof(char)*bs);
-        MPI_Allgather(coding[FTI_Topo.groupRank]+0, bs, MPI_CHAR, dataTmp, bs, MPI_CHAR, FTI_Exec.groupComm);
-        for (i = 0; i < k; i++) memcpy(coding[i]+0, &(dataTmp[i*bs]), sizeof(char)*bs);
-        if (erased[FTI_Topo.groupRank]) // Decoding the lost data work
-            jerasure_matrix_dotprod(k, FTI_Conf.l3WordSize, decMatrix+(FTI_Topo.groupRank*k), dm_ids, FTI_Topo.groupRank, data, coding, bs);
-        MPI_Allgather(data[FTI_Topo.groupRank]+0, bs, MPI_CHAR, dataTmp, bs, MPI_CHAR, FTI_Exec.groupComm);
-        for (i = 0; i < k; i++) memcpy(data[i]+0, &(dataTmp[i*bs]), sizeof(char)*bs);
-        if (erased[FTI_Topo.groupRank + k]) // Finally, re-encode any erased encoded checkpoint file
-            jerasure_matrix_dotprod(k, FTI_Conf.l3WordSize, matrix+(FTI_Topo.groupRank*k), NULL, FTI_Topo.groupRank+k, data, coding, bs);
-        if (erased[FTI_Topo.groupRank]) fwrite(data[FTI_Topo.groupRank]+0, sizeof(char), bs, fd);
-        if (erased[FTI_Topo.groupRank + k]) fwrite(coding[FTI_Topo.groupRank]+0, sizeof(char), bs, efd);
+        if(erased[me] == 0) fread(data, sizeof(char), bs, fd); // Reading the data
+        if(cod && erased[me + k] == 0) fread(coding, sizeof(char), bs, efd);
+        if (nd > 0) { // Our shares of the lost data, added in to their processes
+            for (i = 0; i < nd; i++) outs[i] = parts + i*bs;
+            if (pk > 0 || dec->nbSrc == 0) bzero(parts, nd*bs); // Zero shares are not scheduled
+            if (pk > 0 && dec->nbSrc > 0) FTI_RSxor(srcs, dec->nbSrc, dec->decSched, w, pk, outs, nd, bs);
+            else for (i = 0; i < nd && dec->nbSrc > 0; i++)
+                FTI_RSmul(srcs, dec->nbSrc, dec->decRows+(i*dec->nbSrc), w, outs[i], 0, bs);
+            MPI_Reduce_scatter(parts, data, cntD, MPI_BYTE, MPI_BXOR, FTI_Exec.groupComm);
+        }
+        if (nc > 0) { // Finally, our shares of any erased encoded checkpoint file
+            for (i = 0; i < nc; i++) outs[i] = parts + i*bs;
+            if (pk > 0) { bzero(parts, nc*bs); FTI_RSxor(&data, 1, dec->encSched, w, pk, outs, nc, bs); }
+            else for (i = 0; i < nc; i++) FTI_RSmul(&data, 1, dec->encRows+i, w, outs[i], 0, bs);
+            MPI_Reduce_scatter(parts, coding, cntC, MPI_BYTE, MPI_BXOR, FTI_Exec.groupComm);
+        }
+        if (erased[me]) fwrite(data, sizeof(char), bs, fd);
+        if (cod && erased[me + k]) fwrite(coding, sizeof(char), bs, efd);
         pos = pos + bs;
     }
-    fclose(fd); fclose(efd); // Closing files
+    fclose(fd); if (cod) fclose(efd); // Closing files
     if (truncate(fn,fs) == -1) { FTI_Print("R3 cannot re-truncate checkpoint file.", FTI_DBUG); return FTI_NSCS; }
-    if (truncate(efn,fs) == -1) { FTI_Print("R3 cannot re-truncate encoded ckpt. file.", FTI_DBUG); return FTI_NSCS; }
-    free(tmpmat); free(dm_ids); free(decMatrix); free(matrix); free(data); free(dataTmp); free(coding);
+    if (cod && truncate(efn,ps) == -1) { FTI_Print("R3 cannot re-truncate encoded ckpt. file.", FTI_DBUG); return FTI_NSCS; }
+    free(data); free(coding); free(parts);
     return FTI_SCES;
 }
 
 
 
+/*-------------------------------------------------------------------------*/
+/**
+    @brief      It recovers the lost files of a group with the XOR parity.
+    @param      fs              The ckpt. file size for this process.
+    @param      maxFs           The max. ckpt. file size in the group.
+    @param      erased          The array of erasures.
+    @return     integer         FTI_SCES if successful.
+
+    This function recovers the checkpoint and parity files of the only
+    process of the group with erasures, for the L3 checkpoints taken with
+    L3_xor_parity. Each other process puts its parity block in its own slot
+    of the row read by FTI_XORrow, and the rows are added (XOR) by
+    MPI_Reduce in to the lost process. Each slot then holds the parity of
+    that slot minus the other blocks, which is the lost block sent there,
+    and the slot of the lost process holds its parity again.
+
+ **/
+/*-------------------------------------------------------------------------*/
+int FTI_XORdec(unsigned long fs, unsigned long maxFs, int *erased) {
+    int i, j, x, gs = FTI_Topo.groupSize, me = FTI_Topo.groupRank, bs = FTI_Conf.blockSize;
+    unsigned long nb, rows, t;
+    char *data, *sum, fn[FTI_BUFS], efn[FTI_BUFS];
+    FILE *fd, *efd;
+    for (x = 0; x < gs && !erased[x] && !erased[x+gs]; x++); // The lost process
+    if (x == gs) return FTI_SCES;
+    nb = (maxFs + bs - 1) / bs; rows = (nb + gs - 2) / (gs - 1);
+    if (access(FTI_Ckpt[3].dir, F_OK) != 0) mkdir(FTI_Ckpt[3].dir, 0777);
+    sscanf(FTI_Exec.ckptFile,"Ckpt%d-Rank%d.fti", &FTI_Exec.ckptID, &i);
+    sprintf(fn,"%s/%s",FTI_Ckpt[3].dir, FTI_Exec.ckptFile);
+    sprintf(efn,"%s/Ckpt%d-Pxor%d.fti", FTI_Ckpt[3].dir, FTI_Exec.ckptID, i);
+    if (me != x) { fd = fopen(fn, "rb"); efd = fopen(efn, "rb"); }
+    else { fd = erased[me] ? fopen(fn, "wb") : NULL; efd = fopen(efn, "wb"); }
+    if ((me != x || erased[me]) && fd == NULL) { FTI_Print("R3 cannot open checkpoint file.", FTI_DBUG); return FTI_NSCS; }
+    if (efd == NULL) { FTI_Print("R3 cannot open parity ckpt. file.", FTI_DBUG); return FTI_NSCS; }
+    data = talloc(char, gs*bs); sum = talloc(char, gs*bs);
+    if (me == x) bzero(data, gs*bs); // Nothing to add
+    for (t = 0; t < rows; t++) { // Main loop, row by row
+        if (me != x) {
+            FTI_XORrow(fd, fs, data);
+            if (fread(data + me*bs, sizeof(char), bs, efd) != bs) bzero(data + me*bs, bs);
+        }
+        MPI_Reduce(data, sum, gs*bs, MPI_BYTE, MPI_BXOR, x, FTI_Exec.groupComm);
+        if (me != x) continue;
+        for (j = 0; fd != NULL && j < gs-1 && t*(gs-1)+j < nb; j++) // Blocks sent to the others
+            fwrite(sum + ((me+1+j) % gs)*bs, sizeof(char), bs, fd);
+        fwrite(sum + me*bs, sizeof(char), bs, efd);
+    }
+    free(data); free(sum);
+    if (fd != NULL && fclose(fd) != 0) { FTI_Print("R3 cannot close checkpoint file.", FTI_DBUG); return FTI_NSCS; }
+    if (fclose(efd) != 0) { FTI_Print("R3 cannot close parity ckpt. file.", FTI_DBUG); return FTI_NSCS; }
+    if (me == x && erased[me] && truncate(fn,fs) == -1) { FTI_Print("R3 cannot re-truncate checkpoint file.", FTI_DBUG); return FTI_NSCS; }
+    return FTI_SCES;
+}
+
+
 /*-------------------------------------------------------------------------*/
 /**
     @brief      Checks that all L1 ckpt. files are present.
@@ -123,7 +285,7 @@ int FTI_RecoverL2(int group) {
     int         erased[FTI_BUFS], gs, buf, j, src, dest;
     char        str[FTI_BUFS], lfn[FTI_BUFS], pfn[FTI_BUFS], jfn[FTI_BUFS], qfn[FTI_BUFS];
     char        *blBuf1, *blBuf2, *blBuf3, *blBuf4;
-    unsigned long ps, fs, maxFs, pos = 0;
+    unsigned long ps, fs, pfs, maxFs, pos = 0;
     FILE        *lfd, *pfd, *jfd, *qfd;
     MPI_Request reqSend1, reqRecv1, reqSend2, reqRecv2;
     MPI_Status  status;
@@ -137,6 +299,8 @@ int FTI_RecoverL2(int group) {
     if (access(FTI_Ckpt[2].dir, F_OK) != 0) mkdir(FTI_Ckpt[2].dir, 0777);
     if ( FTI_CheckErasures(&fs, &maxFs, group, erased, 2) != FTI_SCES) // Checking erasures
         { FTI_Print("Error checking erasures.", FTI_DBUG); return FTI_NSCS; }
+    if (FTI_GetPtnerSize(&pfs, NULL, NULL, group, 2) != FTI_SCES) // Size of the left file
+        { FTI_Print("Error getting the partner file size.", FTI_DBUG); return FTI_NSCS; }
     buf = -1; for(j = 0; j < gs; j++) if(erased[j] && erased[((j+1)%gs)+gs]) buf=j; // Counting erasures
     sprintf(str, "A checkpoint file and its partner copy (ID in group : %d) have been lost", buf);
     if (buf > -1) { FTI_Print(str, FTI_DBUG); return FTI_NSCS; }
@@ -200,11 +364,11 @@ int FTI_RecoverL2(int group) {
             if (fclose(lfd) != 0) { FTI_Print("R2 cannot close the checkpoint file.", FTI_DBUG); return FTI_NSCS; }
             if (truncate(lfn,fs) == -1) { FTI_Print("R2 cannot re-truncate the checkpoint file.", FTI_DBUG); return FTI_NSCS; }
             if (fclose(jfd) != 0) { FTI_Print("R2 cannot close the partner ckpt. file.", FTI_DBUG); return FTI_NSCS; }
-            if (truncate(jfn,fs) == -1) { FTI_Print("R2 cannot re-truncate the partner ckpt. file.", FTI_DBUG); return FTI_NSCS; }
+            if (truncate(jfn,pfs) == -1) { FTI_Print("R2 cannot re-truncate the partner ckpt. file.", FTI_DBUG); return FTI_NSCS; }
         }
         if (erased[src] && !erased[gs+FTI_Topo.groupRank]) {
             if (fclose(pfd) != 0) { FTI_Print("R2 cannot close the partner ckpt. file", FTI_DBUG); return FTI_NSCS; }
-            if (truncate(pfn,fs) == -1) { FTI_Print("R2 cannot re-truncate the partner ckpt. file.", FTI_DBUG); return FTI_NSCS; }
+            if (truncate(pfn,pfs) == -1) { FTI_Print("R2 cannot re-truncate the partner ckpt. file.", FTI_DBUG); return FTI_NSCS; }
         }
         if (erased[dest] && !erased[gs+FTI_Topo.groupRank]) {
             if (fclose(qfd) != 0) { FTI_Print("R2 cannot close the ckpt. file", FTI_DBUG); return FTI_NSCS; }
@@ -224,7 +388,10 @@ int FTI_RecoverL2(int group) {
 
     This function tries to recover the L3 ckpt. files missing using the
     RS decoding. If to many files are missing in the group, then we
-    consider this checkpoint unavailable.
+    consider this checkpoint unavailable. Only the first ranks of the
+    group have an encoded file, as many as the parity of the checkpoint,
+    and up to that many files can be lost. Checkpoints with a XOR parity
+    are recovered by FTI_XORdec if only one process lost files.
 
  **/
 /*-------------------------------------------------------------------------*/
@@ -236,8 +403,15 @@ int FTI_RecoverL3(int group) {
     if (access(FTI_Ckpt[3].dir, F_OK) != 0) mkdir(FTI_Ckpt[3].dir, 0777);
     if ( FTI_CheckErasures(&fs, &maxFs, group, erased, 3) != FTI_SCES) // Checking erasures
         { FTI_Print("Error checking erasures.", FTI_DBUG); return FTI_NSCS; }
-    l = 0; for(j = 0; j < gs; j++) { if(erased[j]) l++; if(erased[j+gs]) l++; } // Counting erasures
-    if (l > gs) { FTI_Print("Too many erasures at L3.", FTI_DBUG); return FTI_NSCS; }
+    if (FTI_Exec.l3Xor) { // Single parity, one process of the group can be lost
+        l = 0; for(j = 0; j < gs; j++) { if(erased[j] || erased[j+gs]) l++; } // Counting lost processes
+        if (l > 1) { FTI_Print("Too many erasures at L3.", FTI_DBUG); return FTI_NSCS; }
+        if (l > 0 && FTI_XORdec(fs, maxFs, erased) == FTI_NSCS)
+            { FTI_Print("XOR parity could not regenerate the missing data.", FTI_DBUG); return FTI_NSCS; }
+        return FTI_SCES;
+    }
+    l = 0; for(j = 0; j < gs; j++) { if(erased[j]) l++; if(erased[j+gs] && j < FTI_Exec.l3Parity) l++; } // Counting erasures
+    if (l > FTI_Exec.l3Parity) { FTI_Print("Too many erasures at L3.", FTI_DBUG); return FTI_NSCS; }
     if (l > 0) {
         sprintf(str, "There are %d encoded/checkpoint files missing in this group.", l); FTI_Print(str, FTI_DBUG);
         if (FTI_Decode(fs, maxFs, erased) == FTI_NSCS)
@@ -255,7 +429,8 @@ int FTI_RecoverL3(int group) {
 
     This function tries to recover the ckpt. files using the L4 ckpt. files
     stored in the PFS. If at least one ckpt. file is missing in the PFS, we
-    consider this checkpoint unavailable.
+    consider this checkpoint unavailable. With direct I/O the file is copied
+    by FTI_CopyDirect, which pads and truncates the local file itself.
 
  **/
 /*-------------------------------------------------------------------------*/
@@ -289,6 +464,11 @@ int FTI_RecoverL4(int group) {
     sprintf(gfn,"%s/%s", FTI_Ckpt[4].dir, FTI_Exec.ckptFile); // Open and resize files
     sprintf(lfn,"%s/%s", FTI_Ckpt[1].dir, FTI_Exec.ckptFile);
     if (access(gfn, R_OK) != 0) { FTI_Print("R4 cannot read the checkpoint file in the PFS.", FTI_DBUG); return FTI_NSCS; }
+    if (FTI_Conf.directIO) { // Copy bypassing the page cache, no padding needed on the PFS file
+        free(blBuf1);
+        if (FTI_CopyDirect(gfn, lfn, fs) != FTI_SCES) { FTI_Print("R4 cannot copy the ckpt. file from the PFS.", FTI_DBUG); return FTI_NSCS; }
+        return FTI_SCES;
+    }
     if (truncate(gfn,ps) == -1) { FTI_Print("R4 cannot truncate the ckpt. file in the PFS.", FTI_DBUG); return FTI_NSCS; }
     gfd = fopen(gfn, "rb"); lfd = fopen(lfn, "wb");
     if (gfd == NULL) { FTI_Print("R4 cannot open the ckpt. file in the PFS.", FTI_DBUG); return FTI_NSCS; }
@@ -14,14 +14,17 @@
     @brief      Check if a file exist and that its size is 'correct'.
     @param      fn              The ckpt. file name to check.
     @param      fs              The ckpt. file size tocheck.
+    @param      nb              The number of checksums of the file.
+    @param      cm              The checksums of the file parts.
     @return     integer         0 if file exists, 1 if not or wrong size.
 
     This function checks whether a file exist or not and if its size is
-    the expected one.
+    the expected one. If the metadata has checksums for the file, its
+    content is checked as well and a corrupted file is reported as missing.
 
  **/
 /*-------------------------------------------------------------------------*/
-int FTI_CheckFile(char *fn, unsigned long fs) {
+int FTI_CheckFile(char *fn, unsigned long fs, unsigned int nb, FTIT_crcmeta *cm) {
     struct stat fileStatus;
     if (access(fn, F_OK) == 0)
     {
@@ -29,7 +32,7 @@ int FTI_CheckFile(char *fn, unsigned long fs) {
         {
             if (fileStatus.st_size == fs)
             {
-                return 0;
+                return (FTI_CrcCheck(fn, fs, nb, cm) == FTI_SCES) ? 0 : 1;
             } else {
                 return 1;
             }
@@ -53,12 +56,16 @@ int FTI_CheckFile(char *fn, unsigned long fs) {
     @return     integer         FTI_SCES if successful.
 
     This function detects all the erasures for L1, L2 and L3. It return the
-    results in the erased array. The search for erasures is done at the
+    results in the erased array. Files whose checksums do not match the
+    metadata are counted as erasures. The search for erasures is done at the
     three levels independently on the current recovery level.
 
  **/
 /*-------------------------------------------------------------------------*/
 int FTI_CheckErasures(unsigned long *fs, unsigned long *maxFs, int group, int *erased, int level) {
+    FTIT_crcmeta pcm[FTI_BUFS];
+    unsigned long pfs, ps;
+    unsigned int pnb = 0;
     int         buf;
     char        fn[FTI_BUFS];
     if (FTI_GetMeta(fs, maxFs, group, level) == FTI_SCES)
@@ -74,33 +81,44 @@ int FTI_CheckErasures(unsigned long *fs, unsigned long *maxFs, int group, int *e
     {
         case 1: {
                     sprintf(fn, "%s/%s", FTI_Ckpt[1].dir, FTI_Exec.ckptFile);
-                    buf = FTI_CheckFile(fn, *fs);
+                    buf = FTI_CheckFile(fn, *fs, FTI_Exec.nbCrc, FTI_Exec.crcMeta);
+                    if (buf == 0) buf = FTI_IncCheck(FTI_Ckpt[1].dir); // Incremental chain
                     MPI_Allgather(&buf, 1, MPI_INT, erased, 1, MPI_INT, FTI_Exec.groupComm);
                     break;
                 }
         case 2: {
                     sprintf(fn, "%s/%s", FTI_Ckpt[2].dir, FTI_Exec.ckptFile);
-                    buf = FTI_CheckFile(fn, *fs);
+                    buf = FTI_CheckFile(fn, *fs, FTI_Exec.nbCrc, FTI_Exec.crcMeta);
                     MPI_Allgather(&buf, 1, MPI_INT, erased, 1, MPI_INT, FTI_Exec.groupComm);
                     sscanf(FTI_Exec.ckptFile,"Ckpt%d-Rank%d.fti", &FTI_Exec.ckptID, &buf);
                     sprintf(fn,"%s/Ckpt%d-Pcof%d.fti", FTI_Ckpt[2].dir, FTI_Exec.ckptID, buf);
-                    buf = FTI_CheckFile(fn, *fs);
+                    if (FTI_GetPtnerSize(&pfs, &pnb, pcm, group, level) != FTI_SCES) pfs = *fs;
+                    buf = FTI_CheckFile(fn, pfs, pnb, pcm); // Partner file has the size of the left file
                     MPI_Allgather(&buf, 1, MPI_INT, erased+FTI_Topo.groupSize, 1, MPI_INT, FTI_Exec.groupComm);
                     break;
                 }
         case 3: {
                     sprintf(fn, "%s/%s", FTI_Ckpt[3].dir, FTI_Exec.ckptFile);
-                    buf = FTI_CheckFile(fn, *fs);
+                    buf = FTI_CheckFile(fn, *fs, FTI_Exec.nbCrc, FTI_Exec.crcMeta);
                     MPI_Allgather(&buf, 1, MPI_INT, erased, 1, MPI_INT, FTI_Exec.groupComm);
                     sscanf(FTI_Exec.ckptFile,"Ckpt%d-Rank%d.fti", &FTI_Exec.ckptID, &buf);
-                    sprintf(fn,"%s/Ckpt%d-RSed%d.fti", FTI_Ckpt[3].dir, FTI_Exec.ckptID, buf);
-                    buf = FTI_CheckFile(fn, *fs);
+                    ps = (*maxFs+FTI_Conf.blockSize-1)/FTI_Conf.blockSize;
+                    if (FTI_Exec.l3Xor)
+                    { // One parity block per row of groupSize-1 blocks
+                        sprintf(fn,"%s/Ckpt%d-Pxor%d.fti", FTI_Ckpt[3].dir, FTI_Exec.ckptID, buf);
+                        ps = ((ps+FTI_Topo.groupSize-2)/(FTI_Topo.groupSize-1))*FTI_Conf.blockSize;
+                    } else {
+                        sprintf(fn,"%s/Ckpt%d-RSed%d.fti", FTI_Ckpt[3].dir, FTI_Exec.ckptID, buf);
+                        ps = ps*FTI_Conf.blockSize;
+                    }
+                    buf = FTI_CheckFile(fn, ps, 0, NULL); // Encoded file has the padded size
+                    if (!FTI_Exec.l3Xor && FTI_Topo.groupRank >= FTI_Exec.l3Parity) buf = 1; // No encoded file here
                     MPI_Allgather(&buf, 1, MPI_INT, erased+FTI_Topo.groupSize, 1, MPI_INT, FTI_Exec.groupComm);
                     break;
                 }
         case 4: {
                     sprintf(fn, "%s/%s", FTI_Ckpt[4].dir, FTI_Exec.ckptFile);
-                    buf = FTI_CheckFile(fn, *fs);
+                    buf = FTI_CheckFile(fn, *fs, FTI_Exec.nbCrc, FTI_Exec.crcMeta);
                     MPI_Allgather(&buf, 1, MPI_INT, erased, 1, MPI_INT, FTI_Exec.groupComm);
                     break;
                 }
@@ -116,7 +134,8 @@ int FTI_CheckErasures(unsigned long *fs, unsigned long *maxFs, int group, int *e
 
     This function launchs the required action depending on the recovery
     level. The recovery level is detected from the checkpoint ID of the
-    last checkpoint taken.
+    last checkpoint taken. A valid memory checkpoint (L0) is always newer
+    than the files, as file checkpoints invalidate it, so it is tried first.
 
  **/
 /*-------------------------------------------------------------------------*/
@@ -132,6 +151,12 @@ int FTI_RecoverFiles() {
     }
     if (!FTI_Topo.amIaHead)
     {
+        if (FTI_Exec.reco != 2 && FTI_MemRecover() == FTI_SCES)
+        { // Memory checkpoint, no file to recover
+            FTI_Exec.ckptLvel = 0;
+            FTI_Print("Recovering successfully from level 0.", FTI_INFO);
+            level = 5;
+        }
         while (level < 5)
         {
             if ((FTI_Exec.reco == 2) && (level != 4))
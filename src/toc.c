@@ -0,0 +1,247 @@
+/**
+ *  @file   toc.c
+ *  @author Leonardo A. Bautista Gomez (leobago@gmail.com)
+ *  @date   October, 2026
+ *  @brief  Checkpoint file header and table of contents for the FTI library.
+ */
+
+
+#include "fti.h"
+
+
+/** Signature of the checkpoint files with a table of contents.            */
+static const char          FTI_TocMagic[8] = {'F','T','I','C','K','P','T','\0'};
+
+
+/*-------------------------------------------------------------------------*/
+/**
+    @brief      It gives the size of the header of a checkpoint file.
+    @param      nbVar           Number of datasets in the file.
+    @return     integer         Size of the header area.
+
+    This function returns the size of the header and the table of contents
+    of a checkpoint file, padded to FTI_TOC_ALIGN bytes so that the first
+    dataset starts on an aligned offset.
+
+ **/
+/*-------------------------------------------------------------------------*/
+unsigned long FTI_TocSize(int nbVar) {
+    unsigned long size = sizeof(FTIT_tocheader) + nbVar*sizeof(FTIT_tocentry);
+    return ((size + FTI_TOC_ALIGN - 1) / FTI_TOC_ALIGN) * FTI_TOC_ALIGN;
+}
+
+
+/*-------------------------------------------------------------------------*/
+/**
+    @brief      It builds the header of a checkpoint file.
+    @param      FTI_Data        Dataset array.
+    @param      hsize           Pointer to fill with the header size.
+    @return     char*           Header area, to be freed by the caller.
+
+    This function builds the header and the table of contents of a
+    checkpoint file, padded to FTI_TOC_ALIGN bytes. The datasets follow in
+    protection order. For compressed checkpoints, FTI_WriteComp must have
+    filled the stored sizes first. Otherwise the datasets are stored as
+    they are, and their checksums are computed here if enabled, unless
+    they were already computed for this checkpoint.
+
+ **/
+/*-------------------------------------------------------------------------*/
+char* FTI_TocBuild(FTIT_dataset* FTI_Data, unsigned long *hsize) {
+    FTIT_tocheader *hdr;
+    FTIT_tocentry *toc;
+    unsigned long off;
+    char *buf;
+    int i;
+    *hsize = FTI_TocSize(FTI_Exec.nbVar);
+    buf = calloc(1, *hsize);
+    if (buf == NULL)
+    {
+        FTI_Print("Checkpoint file header could not be allocated.", FTI_EROR);
+        return NULL;
+    }
+    if (FTI_Exec.nbStored == 0 && FTI_Conf.ckptCrc && FTI_Exec.nbCrc == 0) FTI_CrcData(FTI_Data);
+    hdr = (FTIT_tocheader *) buf;
+    toc = (FTIT_tocentry *) (buf + sizeof(FTIT_tocheader));
+    memcpy(hdr->magic, FTI_TocMagic, 8);
+    hdr->version = FTI_TOC_VERSION;
+    hdr->nbVar = FTI_Exec.nbVar;
+    hdr->flags = (FTI_Exec.nbCrc == FTI_Exec.nbVar) ? FTI_TOC_CRC : 0;
+    hdr->dataOff = *hsize;
+    off = *hsize;
+    for (i = 0; i < FTI_Exec.nbVar; i++)
+    {
+        toc[i].id = FTI_Data[i].id;
+        toc[i].eleSize = FTI_Data[i].eleSize;
+        toc[i].count = FTI_Data[i].count;
+        toc[i].offset = off;
+        toc[i].codec = (FTI_Exec.nbStored > 0) ? FTI_Exec.varMeta[i].codec : 0;
+        toc[i].size = (FTI_Exec.nbStored > 0) ? FTI_Exec.varMeta[i].size : FTI_Data[i].size;
+        toc[i].bound = (FTI_Exec.nbStored > 0) ? FTI_Exec.varMeta[i].bound : 0;
+        toc[i].crc = (hdr->flags & FTI_TOC_CRC) ? FTI_Exec.crcMeta[i].crc : 0;
+        off = off + toc[i].size;
+    }
+    hdr->crc = FTI_Crc32c(0, buf, *hsize);
+    return buf;
+}
+
+
+/*-------------------------------------------------------------------------*/
+/**
+    @brief      It reads the header of a checkpoint file.
+    @param      fd              Checkpoint file.
+    @param      hdr             Header to fill.
+    @param      toc             Array of FTI_BUFS entries to fill.
+    @return     integer         1 if valid, 0 if no header, -1 if corrupted.
+
+    This function reads the header and the table of contents at the
+    beginning of a checkpoint file and checks their CRC. Files written
+    before the header existed start directly with the first dataset, they
+    are reported as having no header.
+
+ **/
+/*-------------------------------------------------------------------------*/
+int FTI_TocRead(FILE *fd, FTIT_tocheader *hdr, FTIT_tocentry *toc) {
+    unsigned int crc;
+    char *buf;
+    if (fseek(fd, 0, SEEK_SET) != 0 || fread(hdr, sizeof(FTIT_tocheader), 1, fd) != 1 ||
+        memcmp(hdr->magic, FTI_TocMagic, 8) != 0)
+    {
+        return 0;
+    }
+    if (hdr->version != FTI_TOC_VERSION || hdr->nbVar > FTI_BUFS || hdr->dataOff != FTI_TocSize(hdr->nbVar))
+    {
+        FTI_Print("Checkpoint file header is not valid.", FTI_WARN);
+        return -1;
+    }
+    buf = talloc(char, hdr->dataOff);
+    if (fseek(fd, 0, SEEK_SET) != 0 || fread(buf, 1, hdr->dataOff, fd) != hdr->dataOff)
+    {
+        FTI_Print("Checkpoint file header is truncated.", FTI_WARN);
+        free(buf);
+        return -1;
+    }
+    crc = hdr->crc;
+    ((FTIT_tocheader *) buf)->crc = 0;
+    if (FTI_Crc32c(0, buf, hdr->dataOff) != crc)
+    {
+        FTI_Print("Checkpoint file header is corrupted.", FTI_WARN);
+        free(buf);
+        return -1;
+    }
+    memcpy(toc, buf + sizeof(FTIT_tocheader), hdr->nbVar*sizeof(FTIT_tocentry));
+    free(buf);
+    return 1;
+}
+
+
+/*-------------------------------------------------------------------------*/
+/**
+    @brief      It reads the protected datasets from a checkpoint stream.
+    @param      fd              Checkpoint file or memory stream.
+    @param      FTI_Data        Dataset array.
+    @param      id              ID of the dataset to read, -1 for all.
+    @return     integer         FTI_SCES if successful.
+
+    This function looks up each protected dataset by ID in the table of
+    contents of the checkpoint, checks that it has the same element size
+    and count as at checkpoint time, and reads it from its offset.
+    Datasets of the checkpoint that are not protected anymore are skipped.
+    For files without header, the datasets are expected in protection
+    order, with the codecs and sizes of the metadata if they were
+    compressed. When an ID is given, only the range of that dataset is
+    read. With Mmap_restart, the datasets stored as they are and marked by
+    FTI_Mappable get mapped in place by FTI_MapVar.
+
+ **/
+/*-------------------------------------------------------------------------*/
+int FTI_ReadCkptFd(FILE *fd, FTIT_dataset* FTI_Data, int id) {
+    FTIT_tocentry toc[FTI_BUFS];
+    FTIT_tocheader hdr;
+    unsigned long off = 0;
+    char str[FTI_BUFS];
+    int i, k, nb, res = FTI_SCES;
+    k = FTI_TocRead(fd, &hdr, toc);
+    if (k < 0) return FTI_NSCS;
+    if (k == 1)
+    {
+        nb = hdr.nbVar;
+    } else { // Older file, layout given by the protection order
+        nb = (FTI_Exec.nbStored > 0) ? FTI_Exec.nbStored : FTI_Exec.nbVar;
+        for (k = 0; k < nb; k++)
+        {
+            toc[k].id = (FTI_Exec.nbStored > 0) ? FTI_Exec.varMeta[k].id : FTI_Data[k].id;
+            toc[k].codec = (FTI_Exec.nbStored > 0) ? FTI_Exec.varMeta[k].codec : 0;
+            toc[k].size = (FTI_Exec.nbStored > 0) ? FTI_Exec.varMeta[k].size : FTI_Data[k].size;
+            toc[k].bound = (FTI_Exec.nbStored > 0) ? FTI_Exec.varMeta[k].bound : 0;
+            toc[k].eleSize = 0;
+            toc[k].offset = off;
+            off = off + toc[k].size;
+        }
+    }
+    for (i = 0; i < FTI_Exec.nbVar && res == FTI_SCES; i++)
+    {
+        if (id >= 0 && FTI_Data[i].id != id) continue;
+        for (k = 0; k < nb && toc[k].id != FTI_Data[i].id; k++);
+        if (k == nb)
+        {
+            sprintf(str, "Dataset #%d is not in the checkpoint file.", FTI_Data[i].id);
+            FTI_Print(str, FTI_EROR);
+            res = FTI_NSCS;
+        } else if (toc[k].eleSize != 0 &&
+                   (toc[k].eleSize != FTI_Data[i].eleSize || toc[k].count != FTI_Data[i].count))
+        {
+            sprintf(str, "Dataset #%d was checkpointed with %ld elements of %d bytes.",
+                    FTI_Data[i].id, toc[k].count, toc[k].eleSize);
+            FTI_Print(str, FTI_EROR);
+            res = FTI_NSCS;
+        } else if (FTI_Conf.mmapRestart && FTI_Data[i].mappable && toc[k].codec == 0 && toc[k].size == FTI_Data[i].size &&
+                   fileno(fd) != -1 && FTI_MapVar(fileno(fd), &FTI_Data[i], toc[k].offset) == FTI_SCES)
+        { // Stored as it is, pages read when touched
+            sprintf(str, "Dataset #%d mapped from the checkpoint file.", FTI_Data[i].id);
+            FTI_Print(str, FTI_DBUG);
+        } else if (fseek(fd, toc[k].offset, SEEK_SET) != 0)
+        {
+            res = FTI_NSCS;
+        } else {
+            res = FTI_ReadVar(fd, &FTI_Data[i], &toc[k]);
+        }
+    }
+    return res;
+}
+
+
+/*-------------------------------------------------------------------------*/
+/**
+    @brief      It reads the protected datasets from a checkpoint file.
+    @param      fn              Name of the checkpoint file.
+    @param      FTI_Data        Dataset array.
+    @param      id              ID of the dataset to read, -1 for all.
+    @return     integer         FTI_SCES if successful.
+
+    This function opens the checkpoint file and reads the datasets with
+    FTI_ReadCkptFd.
+
+ **/
+/*-------------------------------------------------------------------------*/
+int FTI_ReadCkpt(char *fn, FTIT_dataset* FTI_Data, int id) {
+    FILE *fd;
+    fd = fopen(fn, "rb");
+    if (fd == NULL)
+    {
+        FTI_Print("Could not open FTI checkpoint file.", FTI_EROR);
+        return FTI_NSCS;
+    }
+    if (FTI_ReadCkptFd(fd, FTI_Data, id) != FTI_SCES)
+    {
+        FTI_Print("FTI checkpoint file could not be read.", FTI_EROR);
+        fclose(fd);
+        return FTI_NSCS;
+    }
+    if (fclose(fd) != 0)
+    {
+        FTI_Print("Could not close FTI checkpoint file.", FTI_EROR);
+        return FTI_NSCS;
+    }
+    return FTI_SCES;
+}
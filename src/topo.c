@@ -271,6 +271,7 @@ int FTI_CreateComms(int *userProcList, int *distProcList, int* nodeList) {
         }
     }
     MPI_Comm_rank(FTI_COMM_WORLD, &FTI_Topo.splitRank);
+    FTI_Exec.postComm = FTI_COMM_WORLD;
     buf = FTI_Topo.sectorID*FTI_Topo.groupSize;
     for (i = 0; i < FTI_Topo.groupSize; i++)
     { // Group of node-distributed processes (Topology-aware).
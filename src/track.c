@@ -0,0 +1,258 @@
+/**
+ *  @file   track.c
+ *  @author Leonardo A. Bautista Gomez (leobago@gmail.com)
+ *  @date   October, 2026
+ *  @brief  Page-protection based dirty tracking for the FTI library.
+ */
+
+
+#include "fti.h"
+#include <signal.h>
+#include <sys/mman.h>
+
+
+/** Pages written since the last checkpoint, per dataset.                  */
+static unsigned char       *FTI_TrackLive[FTI_BUFS];
+
+/** Pages written before the last checkpoint, per dataset.                 */
+static unsigned char       *FTI_TrackSnap[FTI_BUFS];
+
+/** Dataset address when tracking started, per dataset.                    */
+static char                *FTI_TrackBase[FTI_BUFS];
+
+/** First page fully covered by the dataset, per dataset.                  */
+static char                *FTI_TrackStart[FTI_BUFS];
+
+/** Number of pages fully covered by the dataset, per dataset.             */
+static unsigned long       FTI_TrackPages[FTI_BUFS];
+
+/** Number of datasets with tracking state.                                */
+static int                 FTI_TrackNb = 0;
+
+/** System page size.                                                      */
+static unsigned long       FTI_PageSize = 0;
+
+/** Handler installed before ours, called for faults we do not own.        */
+static struct sigaction    FTI_TrackOld;
+
+/** TRUE if the SIGSEGV handler is installed.                              */
+static int                 FTI_TrackOn = 0;
+
+
+/*-------------------------------------------------------------------------*/
+/**
+    @brief      SIGSEGV handler marking the written pages as dirty.
+    @param      sig             Signal number.
+    @param      info            Signal information (faulting address).
+    @param      ctx             Signal context.
+    @return     void
+
+    This function catches the write faults on the protected pages of the
+    tracked datasets, marks the page as dirty and gives write access back
+    to it. Any other fault is passed to the previous handler, or to the
+    default action if there was none.
+
+ **/
+/*-------------------------------------------------------------------------*/
+void FTI_TrackHandler(int sig, siginfo_t *info, void *ctx) {
+    char *addr = (char *) info->si_addr;
+    unsigned long p;
+    int i;
+    for (i = 0; i < FTI_TrackNb; i++)
+    {
+        if (FTI_TrackLive[i] != NULL && addr >= FTI_TrackStart[i] &&
+            addr < FTI_TrackStart[i] + FTI_TrackPages[i]*FTI_PageSize)
+        {
+            p = (addr - FTI_TrackStart[i]) / FTI_PageSize;
+            FTI_TrackLive[i][p] = 1;
+            mprotect(FTI_TrackStart[i] + p*FTI_PageSize, FTI_PageSize, PROT_READ | PROT_WRITE);
+            return;
+        }
+    }
+    if (FTI_TrackOld.sa_flags & SA_SIGINFO)
+    {
+        FTI_TrackOld.sa_sigaction(sig, info, ctx);
+    } else if (FTI_TrackOld.sa_handler != SIG_DFL && FTI_TrackOld.sa_handler != SIG_IGN)
+    {
+        FTI_TrackOld.sa_handler(sig);
+    } else { // The instruction faults again with the default action
+        signal(sig, SIG_DFL);
+    }
+}
+
+
+/*-------------------------------------------------------------------------*/
+/**
+    @brief      It changes the protection of the dirty pages of a map.
+    @param      i               Index of the dataset.
+    @param      map             Page map (1 for the pages to change).
+    @param      prot            New protection of the pages.
+    @return     void
+
+    This function calls mprotect once per run of consecutive pages set in
+    the map.
+
+ **/
+/*-------------------------------------------------------------------------*/
+void FTI_TrackProtect(int i, unsigned char *map, int prot) {
+    unsigned long p = 0, q;
+    while (p < FTI_TrackPages[i])
+    {
+        if (map[p])
+        {
+            for (q = p; q < FTI_TrackPages[i] && map[q]; q++);
+            mprotect(FTI_TrackStart[i] + p*FTI_PageSize, (q-p)*FTI_PageSize, prot);
+            p = q;
+        } else {
+            p++;
+        }
+    }
+}
+
+
+/*-------------------------------------------------------------------------*/
+/**
+    @brief      It starts or restarts tracking the writes of a dataset.
+    @param      FTI_Data        Dataset array.
+    @param      i               Index of the dataset.
+    @return     integer         FTI_SCES if successful.
+
+    This function computes the pages fully covered by the dataset, which
+    are the only ones that can be protected, and marks all of them as dirty.
+    They are protected at the next checkpoint. If the dataset was already
+    tracked at another address, the old pages are released first. The
+    SIGSEGV handler is installed with the first tracked dataset.
+
+ **/
+/*-------------------------------------------------------------------------*/
+int FTI_TrackInit(FTIT_dataset* FTI_Data, int i) {
+    struct sigaction sa;
+    unsigned long start, end;
+    if (FTI_PageSize == 0) FTI_PageSize = sysconf(_SC_PAGESIZE);
+    if (FTI_TrackLive[i] != NULL)
+    { // Give back write access to the old pages
+        mprotect(FTI_TrackStart[i], FTI_TrackPages[i]*FTI_PageSize, PROT_READ | PROT_WRITE);
+        free(FTI_TrackLive[i]);
+        free(FTI_TrackSnap[i]);
+        FTI_TrackLive[i] = NULL;
+    }
+    start = ((unsigned long) FTI_Data[i].ptr + FTI_PageSize - 1) / FTI_PageSize * FTI_PageSize;
+    end = ((unsigned long) FTI_Data[i].ptr + FTI_Data[i].size) / FTI_PageSize * FTI_PageSize;
+    FTI_TrackBase[i] = FTI_Data[i].ptr;
+    FTI_TrackStart[i] = (char *) start;
+    FTI_TrackPages[i] = (end > start) ? (end - start) / FTI_PageSize : 0;
+    FTI_TrackSnap[i] = talloc(unsigned char, FTI_TrackPages[i] + 1);
+    memset(FTI_TrackSnap[i], 1, FTI_TrackPages[i] + 1);
+    FTI_TrackLive[i] = talloc(unsigned char, FTI_TrackPages[i] + 1);
+    memset(FTI_TrackLive[i], 1, FTI_TrackPages[i] + 1);
+    if (i >= FTI_TrackNb) FTI_TrackNb = i + 1;
+    if (!FTI_TrackOn)
+    {
+        memset(&sa, 0, sizeof(sa));
+        sa.sa_sigaction = FTI_TrackHandler;
+        sa.sa_flags = SA_SIGINFO | SA_RESTART;
+        sigemptyset(&sa.sa_mask);
+        if (sigaction(SIGSEGV, &sa, &FTI_TrackOld) != 0)
+        {
+            FTI_Print("SIGSEGV handler could not be installed.", FTI_EROR);
+            return FTI_NSCS;
+        }
+        FTI_TrackOn = 1;
+    }
+    return FTI_SCES;
+}
+
+
+/*-------------------------------------------------------------------------*/
+/**
+    @brief      It takes the dirty pages of the current checkpoint.
+    @return     integer         FTI_SCES if successful.
+
+    This function is called when the checkpoint data is captured. The pages
+    written since the previous checkpoint become the ones queried by
+    FTI_TrackBlock for this checkpoint, and they are protected again so
+    that the next writes are caught.
+
+ **/
+/*-------------------------------------------------------------------------*/
+int FTI_TrackCapture() {
+    unsigned char *tmp;
+    int i;
+    for (i = 0; i < FTI_TrackNb; i++)
+    {
+        if (FTI_TrackLive[i] != NULL)
+        {
+            tmp = FTI_TrackSnap[i];
+            FTI_TrackSnap[i] = FTI_TrackLive[i];
+            memset(tmp, 0, FTI_TrackPages[i] + 1);
+            FTI_TrackLive[i] = tmp;
+            FTI_TrackProtect(i, FTI_TrackSnap[i], PROT_READ);
+        }
+    }
+    return FTI_SCES;
+}
+
+
+/*-------------------------------------------------------------------------*/
+/**
+    @brief      It tells whether a block of a dataset was written.
+    @param      i               Index of the dataset.
+    @param      off             Offset of the block in the dataset.
+    @param      len             Size of the block.
+    @return     integer         1 if dirty, 0 if clean, -1 if unknown.
+
+    This function checks the pages of the last captured checkpoint that
+    cover a block. The result is unknown if the dataset is not tracked or
+    if the block is not fully in protected pages.
+
+ **/
+/*-------------------------------------------------------------------------*/
+int FTI_TrackBlock(int i, long off, unsigned long len) {
+    char *addr;
+    unsigned long p, q;
+    if (i >= FTI_TrackNb || FTI_TrackSnap[i] == NULL) return -1;
+    addr = FTI_TrackBase[i] + off;
+    if (addr < FTI_TrackStart[i] || addr + len > FTI_TrackStart[i] + FTI_TrackPages[i]*FTI_PageSize)
+    {
+        return -1;
+    }
+    q = (addr + len - 1 - FTI_TrackStart[i]) / FTI_PageSize;
+    for (p = (addr - FTI_TrackStart[i]) / FTI_PageSize; p <= q; p++)
+    {
+        if (FTI_TrackSnap[i][p]) return 1;
+    }
+    return 0;
+}
+
+
+/*-------------------------------------------------------------------------*/
+/**
+    @brief      It stops tracking all the datasets.
+    @return     integer         FTI_SCES if successful.
+
+    This function gives write access back to all the tracked pages, frees
+    the page maps and restores the previous SIGSEGV handler.
+
+ **/
+/*-------------------------------------------------------------------------*/
+int FTI_TrackStop() {
+    int i;
+    for (i = 0; i < FTI_TrackNb; i++)
+    {
+        if (FTI_TrackLive[i] != NULL)
+        {
+            mprotect(FTI_TrackStart[i], FTI_TrackPages[i]*FTI_PageSize, PROT_READ | PROT_WRITE);
+            free(FTI_TrackLive[i]);
+            free(FTI_TrackSnap[i]);
+            FTI_TrackLive[i] = NULL;
+            FTI_TrackSnap[i] = NULL;
+        }
+    }
+    FTI_TrackNb = 0;
+    if (FTI_TrackOn)
+    {
+        sigaction(SIGSEGV, &FTI_TrackOld, NULL);
+        FTI_TrackOn = 0;
+    }
+    return FTI_SCES;
+}